@@ -0,0 +1,124 @@
+#include <HTTP/HeaderScan.h>
+#include <Utils.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#define BENCH_HAS_TSC
+
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#else
+		#include <x86intrin.h>
+	#endif
+#endif
+
+// scans a typical response header block line by line (as HTTPParser does) with each
+// implementation the CPU can run, and splits it the way the client did before HTTPParser
+// (the baseline); cycles are TSC cycles, they tick at the nominal frequency
+namespace
+{
+	const char HEADER_BLOCK[] =
+		"HTTP/1.1 200 OK\r\n"
+		"Server: nginx/1.18.0 (Ubuntu)\r\n"
+		"Date: Fri, 16 Oct 2026 11:52:16 GMT\r\n"
+		"Content-Type: application/json; charset=utf-8\r\n"
+		"Content-Length: 1024\r\n"
+		"Connection: keep-alive\r\n"
+		"X-Powered-By: Express\r\n"
+		"Access-Control-Allow-Origin: *\r\n"
+		"ETag: W/\"400-2jmj7l5rSw0yVb/vlWAYkK/YBwk\"\r\n"
+		"Set-Cookie: connect.sid=s%3AuWKvR0n3lZ9hHkS2Xo5yKqJ0xJ.abcdefghijklmnopqrstuvwxyz0123456789; Path=/; HttpOnly\r\n"
+		"Cache-Control: no-cache\r\n"
+		"\r\n";
+
+	constexpr size_t RUNS = 200000;
+	constexpr size_t WARMUP_RUNS = 10000;
+
+	// sum of the offsets found, so the scans can't be optimized away
+	size_t ScanBlock(const char* data, size_t len)
+	{
+		size_t sum = 0;
+		size_t pos = 0;
+
+		while (pos < len) {
+			size_t colon;
+			size_t nl = HeaderScan::FindLineEnd(data + pos, len - pos, colon);
+
+			if (nl == std::string::npos) {
+				break;
+			}
+			sum += nl + colon;
+			pos += nl + 1;
+		}
+		return sum;
+	}
+
+	// the old ParseResponse(): split into lines, then look for the ':' in each
+	size_t SplitBlock(const std::string& block)
+	{
+		size_t sum = 0;
+
+		for (const auto& line : Utils::Split(block, "\r\n")) {
+			sum += line.size() + line.find(':');
+		}
+		return sum;
+	}
+
+	template <typename Scan>
+	void Measure(const char* name, Scan scan)
+	{
+		const size_t len = sizeof(HEADER_BLOCK) - 1;
+		volatile size_t sink = 0;
+
+		for (size_t i = 0; i < WARMUP_RUNS; ++i) {
+			sink = sink + scan();
+		}
+
+		auto start = std::chrono::steady_clock::now();
+#ifdef BENCH_HAS_TSC
+		unsigned long long start_cycles = __rdtsc();
+#endif
+		for (size_t i = 0; i < RUNS; ++i) {
+			sink = sink + scan();
+		}
+#ifdef BENCH_HAS_TSC
+		unsigned long long cycles = __rdtsc() - start_cycles;
+#endif
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+		double bytes = static_cast<double>(len) * RUNS;
+		std::printf("%-8s %8.1f ns/block %6.2f GB/s", name,
+			static_cast<double>(ns) / RUNS, bytes / static_cast<double>(ns));
+#ifdef BENCH_HAS_TSC
+		std::printf(" %6.2f bytes/cycle", bytes / static_cast<double>(cycles));
+#endif
+		std::printf("\n");
+	}
+
+	void Run(HeaderScan::Impl impl, const char* name)
+	{
+		if (!HeaderScan::SetImpl(impl)) {
+			std::printf("%-8s skipped, the CPU can't run it\n", name);
+			return;
+		}
+
+		Measure(name, [] { return ScanBlock(HEADER_BLOCK, sizeof(HEADER_BLOCK) - 1); });
+	}
+}
+
+int main()
+{
+	std::printf("%zu-byte header block, %zu runs\n", sizeof(HEADER_BLOCK) - 1, RUNS);
+
+	// a copy, like the response's raw buffer Split() used to get
+	std::string block(HEADER_BLOCK, sizeof(HEADER_BLOCK) - 1);
+	Measure("split", [&] { return SplitBlock(block); });
+
+	Run(HeaderScan::Impl::SCALAR, "scalar");
+	Run(HeaderScan::Impl::SSE42, "sse4.2");
+	Run(HeaderScan::Impl::AVX2, "avx2");
+	return 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <HTTP/Client.h>
+#include <HTTP/Refresher.h>
 #include <CmdProc.h>
 
 #include <Errors.h>
@@ -22,22 +23,45 @@ public:
 
 private:
 	ECode RegisterCommands();
-	void CMD_Register(SMap& prompts);
-	void CMD_Login(SMap& prompts);
-	void CMD_Logout(SMap& prompts);
-	void CMD_Exit(SMap& prompts);
+	// Ctrl-C cancels the requests of the command in the foreground; without one it ends the program as usual
+	void InstallInterruptHandler();
+	// the client's limits, for the requests of a command with its own cancel token
+	HTTPDeadline GetDeadline(CancelToken& cancel) const;
 
-	void CMD_Enter_Library(SMap& prompts);
-	void CMD_Get_Books(SMap& prompts);
-	void CMD_Get_Book(SMap& prompts);
-	void CMD_Add_Book(SMap& prompts);
-	void CMD_Delete_Book(SMap& prompts);
+	// login -> enter_library -> get_books are coroutines, each request is co_await'ed
+	void CMD_Register(SMap& prompts, CancelToken& cancel);
+	Task<> CMD_Login(SMap& prompts, CancelToken& cancel);
+	void CMD_Logout(SMap& prompts, CancelToken& cancel);
+	void CMD_Exit(SMap& prompts, CancelToken& cancel);
+
+	Task<> CMD_Enter_Library(SMap& prompts, CancelToken& cancel);
+	Task<> CMD_Get_Books(SMap& prompts, CancelToken& cancel);
+	void CMD_Get_Book(SMap& prompts, CancelToken& cancel);
+	void CMD_Add_Book(SMap& prompts, CancelToken& cancel);
+	void CMD_Delete_Book(SMap& prompts, CancelToken& cancel);
 
 	bool _running;
 	HTTPClient _client;
+	// the book list, refreshed in the background (through `_client`) once in the library
+	HTTPRefresher _books;
+	bool _refresh_books;
 	CmdProc _cmd_proc;
 	SMap _user_headers;
 
 	static constexpr char SERVER_HOST[] = "ec2-3-8-116-10.eu-west-2.compute.amazonaws.com";
 	static constexpr int  SERVER_PORT   = 8080;
+
+	// warm connections opened at startup (0 = connect lazily on the first command)
+	static constexpr size_t PREWARM_CONNECTIONS = 1;
+
+	// so a slow server can't hang the prompt
+	static constexpr std::chrono::seconds REQUEST_CONNECT_TIMEOUT{ 10 };
+	static constexpr std::chrono::seconds REQUEST_SEND_TIMEOUT{ 10 };
+	static constexpr std::chrono::seconds REQUEST_RECV_TIMEOUT{ 30 };
+	static constexpr int REQUEST_MAX_RETRIES = 3;
+	static constexpr size_t RESPONSE_CACHE_BYTES = 8 * 1024 * 1024;
+	// 0 = get_books always asks the server
+	static constexpr std::chrono::seconds BOOKS_REFRESH_INTERVAL{ 30 };
+	// threads running get_books / get_book while the next command is typed
+	static constexpr size_t COMMAND_WORKERS = 2;
 };
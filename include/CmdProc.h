@@ -2,31 +2,84 @@
 
 #include <string>
 #include <list>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 
+#include <HTTP/Deadline.h>
+
 #include <Errors.h>
+#include <MPSCQueue.h>
 #include <SMap.h>
+#include <Task.h>
+#include <ThreadPool.h>
 
 class CmdProc
 {
 public:
-	using Callback = std::function<void(SMap&)>;
+	// every command gets a token of its own for its requests, see CancelForeground()
+	using Callback = std::function<void(SMap&, CancelToken&)>;
 
-	CmdProc() = default;
+	// `background` commands run on one of `workers` threads: the prompt comes back right away and
+	// what they log is printed as soon as they're done; any other command first waits for them,
+	// then runs on the thread reading the commands
+	// everything meant for stdout (the prompts, the commands' output, other threads' logs) goes
+	// through one printer thread, which redraws the prompt after printing over it
+	explicit CmdProc(size_t workers = 1);
 	CmdProc(const CmdProc&) = delete;
 	CmdProc& operator=(const CmdProc&) = delete;
+	~CmdProc();
 
-	ECode Register(const std::string& name, const std::list<std::string>& prompts, Callback callback);
+	ECode Register(const std::string& name, const std::list<std::string>& prompts, Callback callback, bool background = false);
+	// the command is a coroutine: it may co_await requests one after the other without holding
+	// up the thread driving them; it runs where a Register()'ed one would
+	using TaskCallback = std::function<Task<>(SMap&, CancelToken&)>;
+	ECode RegisterTask(const std::string& name, const std::list<std::string>& prompts, TaskCallback callback, bool background = false);
 	ECode Unregister(const std::string& name);
 
 	ECode ProcessNewCommand();
+	// waits for the background commands and for what they logged to be printed
+	void WaitBackground();
+	// cancels the requests of the command running in the foreground (the background ones go
+	// on); false if it has none in flight; safe to call from a signal handler
+	bool CancelForeground();
 
 private:
+	struct Output {
+		enum class Kind { TEXT, PROMPT, INPUT };
+
+		Kind kind = Kind::TEXT;
+		std::string text;
+	};
+
+	// queues it for the printer, from any thread
+	void Print(Output::Kind kind, std::string text);
+	// blocks until everything queued so far is printed
+	void Flush();
+	void Printer();
+
 	struct Entry {
 		Callback callback;
 		std::list<std::string> prompts;
+		bool background;
 	};
 
 	std::unordered_map<std::string, Entry> _commands;
+	CancelToken _foreground;
+
+	MPSCQueue<Output> _output;
+	std::atomic<size_t> _queued;
+	std::atomic<size_t> _printed;
+	std::mutex _print_mutex;
+	std::condition_variable _print_cond;
+	bool _stop;
+	// the printer's own: a prompt is on the screen, waiting for input
+	bool _at_prompt;
+	std::string _prompt;
+	std::thread _printer;
+
+	ThreadPool _workers;
 };
\ No newline at end of file
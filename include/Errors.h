@@ -1,6 +1,14 @@
 #pragma once
 
+// fmt 6 captures `this` through [=], deprecated since C++20
+#ifdef __GNUC__
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wdeprecated"
+#endif
 #include <fmt/ostream.h>
+#ifdef __GNUC__
+    #pragma GCC diagnostic pop
+#endif
 
 enum class ECode
 {
@@ -14,6 +22,11 @@ enum class ECode
     SOCKET_CONNECT,
     SOCKET_SEND,
     SOCKET_RECV,
+    ABORTED,
+    BAD_RESPONSE,
+    TIMED_OUT,
+    CANCELLED,
+    CIRCUIT_OPEN,
 
     CMD_ALREADYREGISTERED,
     CMD_NOTREGISTERED,
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <HTTP/Response.h>
+#include <Errors.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// stops sending requests to an endpoint that keeps failing: after enough failures in a row the
+// circuit opens and its requests fail right away with ECode::CIRCUIT_OPEN; after a while it
+// half-opens and lets a single probe through, which closes it again if it succeeds
+class CircuitBreaker
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	enum class State {
+		CLOSED,     // requests go through
+		OPEN,       // requests fail fast
+		HALF_OPEN   // one probe goes through, the others fail fast
+	};
+
+	CircuitBreaker();
+
+	// requests for paths starting with `prefix` share a circuit (the longest prefix wins);
+	// paths that match none aren't guarded
+	void AddEndpoint(const std::string& prefix);
+	// opens after `failures` failures in a row
+	void SetFailureThreshold(int failures);
+	// stays open this long before probing
+	void SetOpenTime(Clock::duration open_time);
+
+	// false if a request for `path` should fail fast
+	bool Allow(const std::string& path);
+	// a request for `path` is actually sent (in half-open, it's the probe)
+	void OnAttempt(const std::string& path);
+	// how a sent request ended: socket errors, timeouts and 5xx responses are failures,
+	// cancelled requests don't count; `response` is nullptr if it failed with `err`
+	void OnResult(const std::string& path, ECode err, const HTTPResponse* response);
+
+	State GetState(const std::string& path);
+
+private:
+	struct Endpoint {
+		std::string prefix;
+		State state = State::CLOSED;
+		int failures = 0;
+		Clock::time_point opened;
+		bool probing = false;
+	};
+
+	Endpoint* Find(const std::string& path);
+	void Update(Endpoint& endpoint);
+
+	std::vector<Endpoint> _endpoints;
+	int _failure_threshold;
+	Clock::duration _open_time;
+
+	static constexpr int FAILURE_THRESHOLD = 5;
+	static constexpr std::chrono::seconds OPEN_TIME{ 10 };
+};
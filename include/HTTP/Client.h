@@ -1,60 +1,352 @@
 #pragma once
 
 #include <HTTP/Response.h>
+#include <HTTP/CircuitBreaker.h>
+#include <HTTP/ConnectionPool.h>
+#include <HTTP/Deadline.h>
+#include <HTTP/HedgePolicy.h>
+#include <HTTP/Resolver.h>
+#include <HTTP/ResponseCache.h>
+#include <HTTP/RetryPolicy.h>
+#include <HTTP/Transport.h>
+#include <HTTP/Transaction.h>
 #include <HTTP/System.h>
+#include <HTTP/Waker.h>
 
 #include <SMap.h>
 #include <Errors.h>
+#include <Task.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
+// can be shared by any number of threads: requests are built from an immutable snapshot of
+// the session (system headers, cookies) and handed to the thread that drives the connections;
+// the policies, cache, deadline and coalescing are configured before the client is shared
 class HTTPClient
 {
 public:
 	HTTPClient(const std::string& server_host, int server_port);
 	HTTPClient(const HTTPClient&) = delete;
 	HTTPClient& operator=(const HTTPClient&) = delete;
+	~HTTPClient();
 
 	static ECode GlobalStartup();
 	static ECode GlobalShutdown();
 
+	struct RequestSpec {
+		std::string method;
+		std::string path;
+		SMap query_params;
+		std::string data;
+		std::string content_type;
+		SMap user_headers;
+		SMap user_cookies;
+		const HTTPDeadline* deadline = nullptr;
+	};
+
+	// `deadline` bounds the request (nullptr = the client's default, see SetDeadline())
 	ECode Request(
 		HTTPResponse& response, const std::string& method, const std::string& path,
 		const SMap& query_params = SMap(), const std::string& data = "", const std::string& content_type = "",
-		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap());
+		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap(), const HTTPDeadline* deadline = nullptr);
 
 	ECode Get(HTTPResponse& response, const std::string& path, const SMap& query_params = SMap(),
-		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap());
+		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap(), const HTTPDeadline* deadline = nullptr);
 	ECode Post(HTTPResponse& response, const std::string& path, const SMap& query_params = SMap(),
 		const std::string& data = "", const std::string& content_type = "",
-		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap());
+		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap(), const HTTPDeadline* deadline = nullptr);
 	ECode Delete(HTTPResponse& response, const std::string& path, const SMap& query_params = SMap(),
-		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap());
+		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap(), const HTTPDeadline* deadline = nullptr);
+
+	struct Result {
+		ECode err = ECode::OK;
+		HTTPResponse response;
+	};
+
+	// return right away, the future is ready once the request is done; the requests are driven
+	// by the client's I/O thread, started by the first of them (see StartEngine())
+	std::future<Result> RequestAsync(
+		const std::string& method, const std::string& path,
+		const SMap& query_params = SMap(), const std::string& data = "", const std::string& content_type = "",
+		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap(), const HTTPDeadline* deadline = nullptr);
+
+	std::future<Result> GetAsync(const std::string& path, const SMap& query_params = SMap(),
+		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap(), const HTTPDeadline* deadline = nullptr);
+	std::future<Result> PostAsync(const std::string& path, const SMap& query_params = SMap(),
+		const std::string& data = "", const std::string& content_type = "",
+		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap(), const HTTPDeadline* deadline = nullptr);
+	std::future<Result> DeleteAsync(const std::string& path, const SMap& query_params = SMap(),
+		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap(), const HTTPDeadline* deadline = nullptr);
+
+	// co_await'ing it sends the request and suspends the coroutine until it's done; the coroutine
+	// is resumed on the I/O thread (started by the first of them, see StartEngine()), after the
+	// client's locks are released: from there on it may co_await more requests and call what
+	// doesn't wait (setters, ClearCookies(), ClearResponseCache(), the async requests, ...), but
+	// not make synchronous requests nor call Run() or StopEngine(), which would wait for the I/O
+	// thread itself; under SyncWait() it's resumed on the waiting thread instead, where all of
+	// them are fine
+	class Awaitable
+	{
+	public:
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> handle);
+		Result await_resume() { return std::move(_result); }
+
+	private:
+		friend class HTTPClient;
+		Awaitable(HTTPClient& client, RequestSpec spec);
+
+		HTTPClient& _client;
+		RequestSpec _spec;
+		Result _result;
+	};
+
+	Awaitable RequestAwait(
+		const std::string& method, const std::string& path,
+		const SMap& query_params = SMap(), const std::string& data = "", const std::string& content_type = "",
+		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap(), const HTTPDeadline* deadline = nullptr);
+
+	Awaitable GetAwait(const std::string& path, const SMap& query_params = SMap(),
+		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap(), const HTTPDeadline* deadline = nullptr);
+	Awaitable PostAwait(const std::string& path, const SMap& query_params = SMap(),
+		const std::string& data = "", const std::string& content_type = "",
+		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap(), const HTTPDeadline* deadline = nullptr);
+	Awaitable DeleteAwait(const std::string& path, const SMap& query_params = SMap(),
+		const SMap& user_headers = SMap(), const SMap& user_cookies = SMap(), const HTTPDeadline* deadline = nullptr);
+
+	// a thread of the client's own drives every request in flight, whoever made it; the
+	// synchronous calls just wait for it; stopping it leaves the requests to the callers again
+	void StartEngine();
+	void StopEngine();
+	bool IsEngineRunning() const;
+
+	// the policies belong to the thread driving the loop: they're replaced as a whole and read
+	// back as copies (eg: GetRetryPolicy(), change the copy, SetRetryPolicy())
+
+	// failed requests are sent again as the policy says (never, by default)
+	void SetRetryPolicy(const RetryPolicy& policy);
+	RetryPolicy GetRetryPolicy();
+
+	// GET responses with an ETag / Last-Modified are kept and only revalidated afterwards,
+	// in up to `max_bytes` (0, the default, turns the cache off)
+	void SetResponseCacheSize(size_t max_bytes);
+	// can be called while the client is shared (eg: on logout)
+	void ClearResponseCache();
+
+	// a GET identical (same path, query and authorization) to one in flight isn't sent,
+	// it gets a copy of that one's answer (off by default)
+	void SetCoalescing(bool enable);
+
+	// requests for endpoints that keep failing fail fast with ECode::CIRCUIT_OPEN (no endpoints by default)
+	void SetCircuitBreaker(const CircuitBreaker& breaker);
+	CircuitBreaker GetCircuitBreaker();
+
+	// slow GETs get a second copy on another connection as the policy says (never, by default)
+	void SetHedgePolicy(const HedgePolicy& policy);
+	HedgePolicy GetHedgePolicy();
+
+	// limits for requests that don't bring their own (none by default)
+	void SetDeadline(const HTTPDeadline& deadline);
+	HTTPDeadline GetDeadline() const;
+
+	// sends all requests at once, spread over the pool; idempotent ones are written back to back
+	// (up to `pipeline depth` per connection) and their responses read in order,
+	// non idempotent ones (eg: POST) get a connection of their own
+	ECode Pipeline(std::vector<HTTPResponse>& responses, const std::vector<RequestSpec>& requests);
+	void SetPipelineDepth(size_t depth);
+
+	// non-blocking interface: Submit() only queues the request, Run() / RunOnce() move every
+	// request in flight forward on the calling thread and call `on_done` when one finishes;
+	// `response` must stay valid until then
+	// with several threads, one at a time drives the requests of all of them (the others wait
+	// for it), so `on_done` runs on whichever thread that is, outside the loop lock; it may call
+	// into the client (eg: Submit()) but not wait
+	using Completion = std::function<void(ECode)>;
+	void Submit(HTTPResponse& response, const RequestSpec& spec, Completion on_done = nullptr);
+	ECode Run();
+	ECode RunOnce(int timeout_ms);
+	size_t GetInFlight() const;
 
 	void ClearCookies();
+	// looks the host up now and waits for it
 	ECode ResolveHost();
+	// looks the host up in the background; requests wait for it only if no address is known yet
+	void ResolveHostAsync();
+	// how long a resolved address is used before looking the host up again
+	void SetResolveTtl(Resolver::Clock::duration ttl);
+
+	// keep the connection open between requests (instead of `connection: close`)
+	void SetKeepAlive(bool enable);
+	bool GetKeepAlive() const;
+	void Close();
+
+	// closes every connection first; returns the transport actually in use
+	Transport::Kind SetTransport(Transport::Kind kind);
+	Transport::Kind GetTransport() const;
+
+	// up to `max_idle` warm connections are kept, each for at most `idle_timeout`
+	void SetPoolLimits(size_t max_idle, ConnectionPool::Clock::duration idle_timeout);
+	void SetMaxConnections(size_t max_connections);
+	// a new connection fails with ECode::SOCKET_CONNECT if none of the host's addresses
+	// accepted it within `timeout`
+	void SetConnectTimeout(ConnectionPool::Clock::duration timeout);
+	// waits for the connections to be established, unless the I/O thread is running (it opens
+	// them) or the host isn't resolved yet (they're opened once it is)
+	size_t Prewarm(size_t count);
 
 private:
-	SOCKET Connect();
-	void Disconnect(SOCKET sockfd);
-	ECode Send(SOCKET sockfd, const std::string& request);
-	ECode Receive(SOCKET sockfd, HTTPResponse& response);
+	struct Pending {
+		HTTPTransaction tx;
+		Completion on_done;
+
+		// hedged requests: the other copy in the race, _pending.end() once it's decided
+		std::list<Pending>::iterator twin;
+		bool hedge = false;             // the second copy, never reported on its own
+		bool hedge_scheduled = false;   // waiting in _hedges
+		bool superseded = false;        // the second copy answered first
+		std::unique_ptr<HTTPResponse> hedge_response;
 
-	std::string FormatRequest(
-		const std::string& method, const std::string& path, const SMap& query_params, const std::string& data,
-		const std::string& content_type, const SMap& headers, const SMap& cookies);
+		// coalesced requests: the ones waiting for this one's answer / the one this one waits for
+		std::vector<std::list<Pending>::iterator> followers;
+		std::list<Pending>::iterator leader;
+	};
+	using PendingIt = std::list<Pending>::iterator;
+
+	// what every request carries; replaced as a whole, a snapshot never changes once published
+	struct Session {
+		SMap headers;
+		SMap cookies;
+		std::shared_ptr<const std::string> static_headers;
+		std::shared_ptr<const std::string> cookie_header;    // nullptr without cookies
+		HTTPDeadline deadline;                              // for requests that don't bring their own
+	};
+
+	std::shared_ptr<const Session> GetSession() const;
+	// publishes a changed copy of the current session; `update` returns false if there's no change,
+	// it's called again on a fresh copy if another thread published in the meantime
+	void UpdateSession(const std::function<bool(Session&)>& update);
+
+	using Finished = std::vector<std::pair<Completion, ECode>>;
+
+	// fills the request in `requests` (a list of its own) on the calling thread
+	PendingIt Start(std::list<Pending>& requests, HTTPResponse& response, bool pipelinable,
+		const HTTPDeadline* deadline, Completion on_done);
+	// hands the requests to the thread driving the loop
+	void Post(std::list<Pending>& requests);
+	// moves the posted requests in, on the driving thread
+	void Admit();
+	// drives the loop until `done` (or a poll fails), or waits while another thread does
+	ECode WaitUntil(const std::function<bool()>& done);
+	// the lock of the loop's state; the thread polling is woken up to let go of it
+	std::unique_lock<std::mutex> LockLoop();
+	// the requests in flight fail with ECode::ABORTED, the connections are closed
+	Finished Abort();
+	void Engine();
+	// attaches the request to an identical one in flight, if there is one
+	void Coalesce(PendingIt it);
+	// hands the answer to the requests that waited for it
+	void Land(PendingIt it);
+	// never waits, ECode::HOST_NORESULT while no address is known
+	ECode UpdateAddress();
+	// fails the requests over their limits / cancelled, returns when to check again
+	HTTPDeadline::Clock::time_point CheckDeadlines();
+	void DispatchWaiting();
+	void OnComplete(PendingIt it);
+	// false if the request can't wait that long
+	bool Retry(PendingIt it, RetryPolicy::Clock::duration delay);
+	// moves the requests done backing off to the waiting queue, returns when the next one is
+	HTTPDeadline::Clock::time_point ReleaseBackoff();
+	// sends the copies of the requests not answered in time, returns when the next one is due
+	HTTPDeadline::Clock::time_point LaunchHedges();
+	void Hedge(PendingIt it);
+	void OnHedgeComplete(PendingIt it);
+	// the request is done for good; the copy still racing it (if any) is cancelled
+	void Complete(PendingIt it);
+	// takes the requests done out of the loop's state; their `on_done` are left to Notify(),
+	// once the loop lock is released
+	Finished FinishCompleted();
+	// calls them, then wakes up the threads waiting in WaitUntil()
+	void Notify(Finished& finished);
+
+	void BuildRequest(
+		HTTPTransaction& tx, const std::string& method, const std::string& path, const SMap& query_params,
+		std::string_view data, const std::string& content_type, const SMap& user_headers, const SMap& user_cookies);
+	bool ProcessResponse(const HTTPResponse& response);
+	// a 304 is swapped for the cached copy, a new 200 is cached
+	void UpdateCache(HTTPTransaction& tx);
+
+	void FormatRequest(
+		HTTPTransaction& tx, const std::string& method, const std::string& path, const SMap& query_params,
+		std::string_view data, const std::string& content_type, const SMap& headers, const SMap& cookies);
 
-	ECode ParseResponse(HTTPResponse& response);
 	void SetupSystemHeaders();
 
 private:
 	std::string _unresolved_host;
 	int _port;
-	sockaddr _address;
+	Resolver _resolver;
+	size_t _prewarm;        // connections to open once the host is resolved
+	bool _resolving;        // the requests waiting without an address asked for a lookup
+
+	std::atomic<bool> _keep_alive;
+	std::unique_ptr<Transport> _transport;
+	Waker _waker;
+	ConnectionPool _pool;
+	size_t _pipeline_depth;
+	RetryPolicy _retry_policy;
+	HedgePolicy _hedge_policy;
+	CircuitBreaker _breaker;
+	ResponseCache _cache;
+	std::atomic<bool> _coalescing;
+	std::unordered_map<std::string, PendingIt> _flights;
+
+	std::list<Pending> _pending;
+	std::deque<PendingIt> _waiting;
+	std::multimap<HTTPDeadline::Clock::time_point, PendingIt> _backoff;
+	std::multimap<HTTPDeadline::Clock::time_point, PendingIt> _hedges;
+	std::deque<PendingIt> _completed;
+
+	// everything above belongs to the thread driving the loop, it's taken with LockLoop()
+	std::mutex _loop_mutex;
+	std::atomic<int> _lockers;
+	// requests built by other threads, not admitted yet
+	std::mutex _inbox_mutex;
+	std::list<Pending> _inbox;
+	std::atomic<size_t> _in_flight;
+	// who drives the loop; the others wait on the condition for their requests
+	std::mutex _driver_mutex;
+	std::condition_variable _driver_cond;
+	bool _driving;
+	// the I/O thread, if started
+	mutable std::mutex _engine_mutex;
+	std::thread _engine;
+	std::atomic<bool> _engine_stop;
 
-	SMap _system_headers;
-	SMap _system_cookies;
+	// replaced with compare_exchange_weak(), see UpdateSession()
+	std::atomic<std::shared_ptr<const Session>> _session;
 
 	static constexpr char HTTP_VERSION[] = "HTTP/1.1";
+	static constexpr size_t POOL_MAX_CONNECTIONS = 4;
+	static constexpr size_t POOL_MAX_IDLE = 4;
+	static constexpr std::chrono::seconds POOL_IDLE_TIMEOUT{ 30 };
+	static constexpr size_t PIPELINE_DEPTH = 16;
+	static constexpr int MAX_ATTEMPTS = 3;
+	static constexpr std::chrono::seconds RESOLVE_TTL{ 60 };
+	static constexpr std::chrono::seconds CONNECT_TIMEOUT{ 5 };
+	// cancellation isn't signaled, tokens are checked this often while their requests are in flight
+	static constexpr std::chrono::milliseconds CANCEL_CHECK_INTERVAL{ 50 };
 };
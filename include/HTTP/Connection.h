@@ -0,0 +1,124 @@
+#pragma once
+
+#include <HTTP/Transport.h>
+#include <HTTP/Parser.h>
+#include <HTTP/Resolver.h>
+#include <HTTP/Transaction.h>
+#include <HTTP/System.h>
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// asynchronous connection to the HTTP server; requests queued on it are written
+// back to back and their responses are matched in order (HTTP/1.1 pipelining)
+class HTTPConnection : public Transport::Handler
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	enum class State {
+		CONNECTING,
+		OPEN,
+		CLOSED
+	};
+
+	HTTPConnection(Transport& transport);
+	HTTPConnection(const HTTPConnection&) = delete;
+	HTTPConnection& operator=(const HTTPConnection&) = delete;
+	~HTTPConnection();
+
+	// races connects to `addresses`, starting with the one at `first` (happy eyeballs): the next one
+	// is tried when the previous fails or hasn't connected after ATTEMPT_DELAY, the first to connect
+	// wins; queued requests fail with ECode::SOCKET_CONNECT if none connects within `timeout`
+	bool Open(const Resolver::AddressList& addresses, size_t first, Clock::duration timeout);
+	void Enqueue(HTTPTransaction& tx);
+
+	// stops using the connection, queued requests fail as retryable
+	void Shutdown();
+	// closes the connection, queued requests fail with `err` and aren't retried
+	void Abort(ECode err);
+	// fails just `tx` with `err`; if it's already (partly) on the wire the connection is closed
+	// and the other requests on it fail as retryable
+	void Cancel(HTTPTransaction& tx, ECode err);
+
+	State GetState() const;
+	size_t GetInFlight() const;
+	size_t GetServed() const;
+	// index of the address it connected to, std::string::npos while connecting / closed
+	size_t GetAddressIndex() const;
+	Clock::time_point GetIdleSince() const;
+
+	bool IsIdle() const;
+	bool IsAlive();
+	bool CanPipeline(size_t depth) const;
+
+	// starts the next connect attempt / gives up connecting when it's time;
+	// only call it outside of connection event handlers
+	void CheckTimers(Clock::time_point now);
+	// when CheckTimers() has something to do next, Clock::time_point::max() if never
+	Clock::time_point GetNextTimer() const;
+
+	void OnConnect(int result) override;
+	void OnSend(int result) override;
+	void OnRecv(int result) override;
+
+private:
+	// a socket racing to connect, the first one to connect becomes the connection's socket
+	class Attempt : public Transport::Handler
+	{
+	public:
+		Attempt(HTTPConnection& owner, SOCKET sockfd, size_t address_index);
+
+		SOCKET GetSocket() const;
+		size_t GetAddressIndex() const;
+
+		void OnConnect(int result) override;
+		void OnSend(int result) override;
+		void OnRecv(int result) override;
+
+	private:
+		HTTPConnection& _owner;
+		SOCKET _sockfd;
+		size_t _address_index;
+	};
+
+	bool StartAttempt();
+	void OnAttemptConnect(Attempt& attempt, int result);
+	void CloseAttempt(Attempt& attempt);
+
+	void PostSend();
+	void PostRecv();
+	void OnClosedByPeer();
+
+	void Receive();
+	void Complete(HTTPTransaction& tx, ECode err);
+	void Fail(ECode err, bool retryable);
+	void Close();
+
+	Transport& _transport;
+	SOCKET _sockfd;
+	State _state;
+	bool _sending;
+
+	std::deque<HTTPTransaction*> _to_send;
+	std::deque<HTTPTransaction*> _to_receive;
+	HTTPParser _parser;
+
+	Resolver::AddressList _addresses;
+	size_t _next_address;
+	size_t _first_address;
+	size_t _address_index;
+	std::vector<std::unique_ptr<Attempt>> _attempts;
+	Clock::time_point _next_attempt;
+	Clock::time_point _connect_deadline;
+
+	size_t _served;
+	Clock::time_point _idle_since;
+
+	static constexpr size_t MAX_SEND_IOVECS = 64;
+	// RFC 8305 "connection attempt delay"
+	static constexpr std::chrono::milliseconds ATTEMPT_DELAY{ 250 };
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <HTTP/Connection.h>
+#include <HTTP/Resolver.h>
+#include <HTTP/Transport.h>
+#include <HTTP/System.h>
+
+#include <Errors.h>
+
+#include <chrono>
+#include <list>
+#include <memory>
+
+class ConnectionPool
+{
+public:
+	using Clock = HTTPConnection::Clock;
+
+	ConnectionPool(Transport& transport, size_t max_connections, size_t max_idle, Clock::duration idle_timeout,
+		Clock::duration connect_timeout);
+	ConnectionPool(const ConnectionPool&) = delete;
+	ConnectionPool& operator=(const ConnectionPool&) = delete;
+	~ConnectionPool();
+
+	// the pool has to be empty (see Clear()) when switching transports
+	void SetTransport(Transport& transport);
+	void SetAddresses(const Resolver::AddressList& addresses);
+	void SetLimits(size_t max_idle, Clock::duration idle_timeout);
+	void SetConnectTimeout(Clock::duration timeout);
+	void SetMaxConnections(size_t max_connections);
+
+	// picks a warm connection, opens a new one if under the limit or, for pipelinable
+	// requests, picks the least busy connection that can take one more;
+	// `conn` is nullptr if the request has to wait for a connection to free up
+	ECode Acquire(HTTPConnection*& conn, bool pipelinable, size_t pipeline_depth);
+
+	size_t Prewarm(size_t count);
+	// destroys closed connections and closes the ones idle for too long / over the idle limit;
+	// only call it outside of connection event handlers
+	void Evict();
+	// moves connects along (see HTTPConnection::CheckTimers()), same restrictions as Evict()
+	void CheckTimers();
+	Clock::time_point GetNextTimer() const;
+	// closes every connection, requests in flight fail with ECode::ABORTED
+	void Clear();
+
+	size_t GetCount() const;
+	size_t GetIdleCount() const;
+	size_t GetConnectingCount() const;
+
+private:
+	HTTPConnection* Open();
+
+	Transport* _transport;
+	Resolver::AddressList _addresses;
+	size_t _preferred;      // the address new connections try first, the last one that worked
+
+	size_t _max_connections;
+	size_t _max_idle;
+	Clock::duration _idle_timeout;
+	Clock::duration _connect_timeout;
+
+	std::list<std::unique_ptr<HTTPConnection>> _connections;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+// cancels the requests it's passed to; Cancel() only touches an atomic, so it can be
+// called from another thread or from a signal / console control handler
+class CancelToken
+{
+public:
+	CancelToken() = default;
+	CancelToken(const CancelToken&) = delete;
+	CancelToken& operator=(const CancelToken&) = delete;
+
+	void Cancel() { _cancelled.store(true); }
+	void Reset() { _cancelled.store(false); }
+	bool IsCancelled() const { return _cancelled.load(); }
+
+	// true while a request using the token is in flight
+	bool IsInUse() const { return _users.load() > 0; }
+
+private:
+	friend class HTTPClient;
+
+	std::atomic<bool> _cancelled{ false };
+	std::atomic<int> _users{ 0 };
+};
+
+// limits for one request, every phase is bounded on its own (zero = no limit);
+// a request over its limit fails with ECode::TIMED_OUT, a cancelled one with ECode::CANCELLED
+struct HTTPDeadline
+{
+	using Clock = std::chrono::steady_clock;
+
+	Clock::duration connect = Clock::duration::zero();  // until it's on an open connection
+	Clock::duration send = Clock::duration::zero();     // to write the whole request once connected
+	Clock::duration recv = Clock::duration::zero();     // from the request written to the full response
+	Clock::duration total = Clock::duration::zero();    // all of the above (and retries) together
+	CancelToken* cancel = nullptr;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <HTTP/System.h>
+
+#include <unordered_map>
+#include <vector>
+
+// readiness based event loop: epoll on Linux, WSAPoll on Windows
+class EventLoop
+{
+public:
+	enum {
+		EVENT_NONE  = 0x00,
+		EVENT_READ  = 0x01,
+		EVENT_WRITE = 0x02,
+		EVENT_ERROR = 0x04
+	};
+
+	class Handler
+	{
+	public:
+		virtual ~Handler() = default;
+		virtual void OnEvent(int events) = 0;
+	};
+
+	EventLoop();
+	EventLoop(const EventLoop&) = delete;
+	EventLoop& operator=(const EventLoop&) = delete;
+	~EventLoop();
+
+	bool Add(SOCKET sockfd, int events, Handler* handler);
+	bool Modify(SOCKET sockfd, int events);
+	void Remove(SOCKET sockfd);
+
+	// waits at most `timeout_ms` (-1 = forever) and dispatches the events,
+	// returns the number of handled events or -1 on error
+	int Poll(int timeout_ms);
+	size_t GetCount() const;
+
+private:
+	struct Entry {
+		int events;
+		Handler* handler;
+	};
+
+	// handlers may remove themselves (or others) while events are dispatched,
+	// so events are always looked up by socket instead of keeping raw pointers
+	std::unordered_map<SOCKET, Entry> _entries;
+
+#ifdef _WIN32
+	std::vector<WSAPOLLFD> _pollfds;
+#else
+	int _epfd;
+	std::vector<epoll_event> _events;
+#endif
+
+	static constexpr size_t MAX_EVENTS = 64;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+// vectorized search for the delimiters of header lines, picked at runtime for the CPU
+// (AVX2, SSE4.2, or plain C++ everywhere else)
+namespace HeaderScan
+{
+	enum class Impl {
+		SCALAR,
+		SSE42,
+		AVX2
+	};
+
+	// offset of the first '\n' in `data` or npos; `colon` gets the offset of the first ':'
+	// before it (npos if there's none, or if the line doesn't end in `data`, the first ':' seen)
+	size_t FindLineEnd(const char* data, size_t len, size_t& colon);
+
+	Impl GetImpl();
+	const char* GetImplName();
+	// false if the CPU can't run `impl`
+	bool SetImpl(Impl impl);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// decides when a request that wasn't answered yet is sent once more on another connection:
+// after a percentile of the latencies seen so far, so only the slowest few get a second copy;
+// the first answer wins and the other copy is cancelled (see HTTPClient)
+class HedgePolicy
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	HedgePolicy();
+
+	// off by default
+	void SetEnabled(bool enable);
+	bool IsEnabled() const;
+	// eg: 0.95 hedges the requests slower than 95% of the previous ones
+	void SetPercentile(double percentile);
+	// never hedged sooner than this
+	void SetMinDelay(Clock::duration delay);
+	// nothing is hedged until this many latencies were seen
+	void SetMinSamples(size_t count);
+	// only requests for paths starting with one of these are hedged (every GET if none)
+	void AddPath(const std::string& prefix);
+
+	// only GET / HEAD, a second copy of anything else could do something twice
+	bool ShouldHedge(const std::string& method, const std::string& path) const;
+	// how long to wait for the first copy; false if there aren't enough samples yet
+	bool GetDelay(Clock::duration& delay) const;
+	void AddSample(Clock::duration latency);
+
+private:
+	bool _enabled;
+	double _percentile;
+	Clock::duration _min_delay;
+	size_t _min_samples;
+	std::vector<std::string> _paths;
+
+	// the last SAMPLE_COUNT latencies, the oldest is overwritten first
+	std::vector<Clock::duration> _samples;
+	size_t _next_sample;
+
+	static constexpr double PERCENTILE = 0.95;
+	static constexpr std::chrono::milliseconds MIN_DELAY{ 10 };
+	static constexpr size_t MIN_SAMPLES = 16;
+	static constexpr size_t SAMPLE_COUNT = 128;
+};
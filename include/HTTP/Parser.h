@@ -0,0 +1,93 @@
+#pragma once
+
+#include <HTTP/Response.h>
+
+#include <string_view>
+#include <vector>
+
+// resumable HTTP/1.1 response parser: bytes are received straight into its buffer and
+// the status line / headers are filled in as soon as they are complete, before the body
+// shows up; the finished response takes the buffer over, the body is never copied
+class HTTPParser
+{
+public:
+	enum class State {
+		IDLE,           // no response attached
+		STATUS_LINE,
+		HEADERS,
+		BODY,           // content-length or close-delimited
+		CHUNK_SIZE,     // chunked bodies are decoded in place, the chunk data is moved next to the previous one
+		CHUNK_DATA,
+		CHUNK_DATA_END,
+		TRAILERS,       // merged into the headers
+		DONE,
+		FAILED
+	};
+
+	HTTPParser();
+
+	// drops the response being parsed and everything buffered
+	void Reset();
+	// starts parsing the next response out of the buffer into `response`; `method` is the
+	// request's, the response to a HEAD has no body whatever its headers say
+	void Attach(HTTPResponse* response, std::string_view method);
+
+	// free space at the end of the buffer for the next receive; once content-length
+	// is known it's grown to fit the rest of the body
+	char* GetRecvBuffer(size_t& len);
+	// `len` bytes were received into the buffer returned by GetRecvBuffer()
+	void Commit(size_t len);
+
+	// parses the buffered bytes up to the end of the current response
+	void Parse();
+	// the server closed the connection, returns true if that ended the response
+	bool FinishEof();
+	// hands the buffer over to the finished response, bytes past its end stay buffered
+	void Finish();
+
+	State GetState() const;
+	HTTPResponse* GetResponse() const;
+
+	bool HasUnparsed() const;
+	bool IsStarted() const;
+	bool HasHeaders() const;
+	bool IsDone() const;
+	bool HasFailed() const;
+
+private:
+	// (re)starts the response, eg: after an interim one
+	void Start();
+
+	bool OnLine(std::string_view line, size_t colon);
+	bool OnStatusLine(std::string_view line);
+	bool OnHeader(std::string_view line, size_t colon);
+	bool OnTrailer(std::string_view line, size_t colon);
+	bool OnHeadersEnd();
+	bool OnChunkSize(std::string_view line);
+
+	void AddField(std::vector<HTTPResponse::FieldRef>& fields, std::string_view key, std::string_view val);
+
+	// `colon` is the offset of the first ':' in the line, as found by the line scan
+	static bool SplitHeader(std::string_view line, size_t colon, std::string_view& key, std::string_view& val);
+
+	HTTPResponse* _response;
+	State _state;
+	bool _head;             // answering a HEAD request
+
+	std::string _buffer;    // its size is the capacity, only the first `_length` bytes are valid
+	size_t _length;
+	size_t _pos;            // parsed up to here
+	size_t _line_start;
+	size_t _colon;          // first ':' of the current line, if any
+	size_t _remaining;      // bytes left of the body / current chunk
+
+	size_t _content_length;
+	bool _chunked;
+	size_t _trailers_length;  // trailer lines moved right after the decoded body
+
+	static constexpr size_t MIN_RECV_SIZE = 16 * 1024;
+	// don't trust content-length with more than this up front
+	static constexpr size_t MAX_PREALLOC_SIZE = 16 * 1024 * 1024;
+	static constexpr size_t MAX_LINE_LENGTH = 64 * 1024;
+	static constexpr size_t INITIAL_FIELDS = 32;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <HTTP/Client.h>
+#include <HTTP/Deadline.h>
+#include <HTTP/Response.h>
+
+#include <SMap.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// keeps a recent copy of one resource (stale-while-revalidate): a background thread GETs it
+// every `interval` through `client` (shared with the other threads), readers get the last copy right away
+class HTTPRefresher
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Snapshot {
+		HTTPResponse response;      // always a 200
+		Clock::time_point fetched;
+
+		Clock::duration GetAge() const { return Clock::now() - fetched; }
+	};
+
+	HTTPRefresher(HTTPClient& client, const std::string& path, Clock::duration interval);
+	HTTPRefresher(const HTTPRefresher&) = delete;
+	HTTPRefresher& operator=(const HTTPRefresher&) = delete;
+	~HTTPRefresher();
+
+	// 0 = only when asked with Refresh()
+	void SetInterval(Clock::duration interval);
+	Clock::duration GetInterval() const;
+	// sent with every request (eg: authorization); the copy made with the old ones is dropped
+	void SetHeaders(const SMap& headers);
+
+	// the first refresh starts right away
+	void Start();
+	// cancels a refresh in flight and waits for the thread
+	void Stop();
+	bool IsRunning() const;
+
+	// refreshes now instead of at the next interval; `invalidate` drops the current copy
+	// (eg: the resource was just changed)
+	void Refresh(bool invalidate);
+	// nullptr if there's no copy yet; a failed refresh keeps the old one
+	std::shared_ptr<const Snapshot> GetSnapshot() const;
+
+private:
+	void Worker();
+
+	HTTPClient& _client;
+	std::string _path;
+	CancelToken _cancel;
+	HTTPDeadline _deadline;
+
+	std::thread _thread;
+	mutable std::mutex _mutex;
+	std::condition_variable _cond;
+	Clock::duration _interval;
+	SMap _headers;
+	bool _stop;
+	bool _refresh;
+	// bumped when the copy is dropped, a refresh that started before can't bring it back
+	uint64_t _generation;
+	std::shared_ptr<const Snapshot> _snapshot;
+
+	static constexpr std::chrono::seconds REFRESH_TIMEOUT{ 30 };
+};
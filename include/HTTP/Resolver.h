@@ -0,0 +1,79 @@
+#pragma once
+
+#include <HTTP/System.h>
+
+#include <Errors.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// resolves the server's name on a background thread and caches the result for `ttl`;
+// expired addresses keep being handed out while the name is resolved again
+class Resolver
+{
+public:
+	using Clock = std::chrono::steady_clock;
+	// every IPv4 / IPv6 address of the host, in the order to try them;
+	// the list is only replaced when a lookup finds different addresses
+	using AddressList = std::shared_ptr<const std::vector<SysAddress>>;
+
+	Resolver(const std::string& host, int port, Clock::duration ttl);
+	Resolver(const Resolver&) = delete;
+	Resolver& operator=(const Resolver&) = delete;
+	// waits for a lookup in progress
+	~Resolver();
+
+	void SetTtl(Clock::duration ttl);
+	// called on the lookup thread after every lookup, with the resolver locked (keep it short);
+	// once this returns, the previous callback isn't running nor called again
+	void SetOnResolved(std::function<void()> on_resolved);
+
+	// starts a lookup in the background (if none is running already)
+	void Refresh();
+	// looks the name up again and waits for the result
+	ECode Resolve(AddressList& addresses);
+
+	// the cached addresses, waits only if there are none yet
+	ECode GetAddresses(AddressList& addresses);
+	// never waits; false if no address is known yet
+	bool TryGetAddresses(AddressList& addresses);
+	bool HasAddress() const;
+	// a lookup is asked for or running
+	bool IsResolving() const;
+	// result of the last lookup
+	ECode GetError() const;
+
+private:
+	void Worker();
+	// with `_mutex` locked; `queue` asks for another lookup after the one running
+	void RefreshLocked(bool queue);
+	bool IsExpired() const;
+
+	static ECode Lookup(const std::string& host, int port, std::vector<SysAddress>& addresses);
+
+	std::string _host;
+	int _port;
+
+	mutable std::mutex _mutex;
+	std::condition_variable _cond;
+	std::thread _thread;
+	bool _requested;
+	bool _resolving;
+	bool _stopping;
+	size_t _lookups;            // finished lookups, to wait for a fresh one
+
+	AddressList _addresses;
+	ECode _error;               // result of the last lookup
+	Clock::duration _ttl;
+	Clock::time_point _expires;
+	std::function<void()> _on_resolved;
+
+	// how long a failed lookup is trusted before trying again
+	static constexpr std::chrono::seconds RETRY_AFTER{ 5 };
+};
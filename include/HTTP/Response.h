@@ -2,34 +2,127 @@
 
 #include <SMap.h>
 
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// once received, a response can be read from several threads at a time through a const
+// reference (eg: a shared snapshot); the copies made on first use are built only once
 class HTTPResponse
 {
 	friend class HTTPClient;
+	friend class HTTPConnection;
+	friend class HTTPParser;
 
 public:
+	struct Field {
+		std::string_view name;
+		std::string_view value;
+	};
+
+	HTTPResponse();
+
 	void Reset();
 
 	int GetCode() const;
 	const std::string& GetStatus() const;
 
+	// case-insensitive lookups straight into the raw response, they don't allocate;
+	// if a name shows up more than once the last one wins
+	std::optional<std::string_view> GetHeader(std::string_view name) const;
+	std::optional<std::string_view> GetCookie(std::string_view name) const;
+
+	size_t GetHeaderCount() const;
+	Field GetHeaderAt(size_t index) const;
+	size_t GetCookieCount() const;
+	Field GetCookieAt(size_t index) const;
+
+	// copies (header names in lowercase), made on first use
 	const SMap& GetHeaders() const;
 	const SMap& GetCookies() const;
+
+	// the body as a view into the raw response, valid until the response is reset / reused
+	std::string_view GetBody() const;
+	// copy of the body, made on first use
 	const std::string& GetData() const;
+	// the whole response as received (chunked bodies already decoded, trailers right after them)
 	const std::string& GetRaw() const;
 
 private:
+	// a copy made on first use, by whichever thread asks first; copying the response doesn't
+	// copy it (nor read it), the new response makes its own
+	template <typename T>
+	class Lazy
+	{
+	public:
+		Lazy() : _built(false) {}
+		Lazy(const Lazy&) noexcept : _built(false) {}
+		Lazy& operator=(const Lazy&) noexcept
+		{
+			Reset();
+			return *this;
+		}
+
+		// while nobody else uses the response, like HTTPResponse::Reset()
+		void Reset()
+		{
+			_value = T();
+			_built.store(false, std::memory_order_relaxed);
+		}
+
+		template <typename Build>
+		const T& Get(Build build) const
+		{
+			if (!_built.load(std::memory_order_acquire)) {
+				std::lock_guard<std::mutex> lock(_mutex);
+
+				if (!_built.load(std::memory_order_relaxed)) {
+					build(_value);
+					_built.store(true, std::memory_order_release);
+				}
+			}
+			return _value;
+		}
+
+	private:
+		mutable std::mutex _mutex;
+		mutable T _value;
+		mutable std::atomic<bool> _built;
+	};
+
+	// where a name / value is in the raw response
+	struct FieldRef {
+		uint32_t name_offset;
+		uint32_t name_length;
+		uint32_t value_offset;
+		uint32_t value_length;
+	};
+
+	const std::string& GetStorage() const;
+	Field Resolve(const FieldRef& ref) const;
+	std::optional<std::string_view> Find(const std::vector<FieldRef>& fields, std::string_view name) const;
+
 	// status line
 	int _code;
 	std::string _status;
 	std::string _protover;
 
 	// headers
-	SMap _headers;
-	SMap _cookies;
+	std::vector<FieldRef> _header_fields;
+	std::vector<FieldRef> _cookie_fields;
+	Lazy<SMap> _headers;
+	Lazy<SMap> _cookies;
 
 	// data
-	std::string _data;
+	size_t _body_offset;
+	size_t _body_length;
+	Lazy<std::string> _data;
 
 	// full response - raw
 	std::string _raw;
+	// the parser's buffer while the response is still being received
+	const std::string* _receiving;
 };
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <HTTP/Response.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// copies of responses that can be revalidated (they came with an ETag / Last-Modified): the
+// request for one is sent with If-None-Match / If-Modified-Since and a 304 is answered with the
+// copy; the least recently used ones are dropped to stay under a size limit
+class ResponseCache
+{
+public:
+	ResponseCache();
+
+	// 0 (the default) disables the cache
+	void SetMaxBytes(size_t max_bytes);
+	size_t GetMaxBytes() const;
+	size_t GetSize() const;
+
+	// nullptr if there's no copy; it stays valid even if it's dropped from the cache meanwhile
+	std::shared_ptr<const HTTPResponse> Find(const std::string& key);
+	// keeps a copy if it can be revalidated, isn't `no-store` and fits
+	void Store(const std::string& key, const HTTPResponse& response);
+	void Remove(const std::string& key);
+	void Clear();
+
+	// adds the conditional headers for `cached` to a block of request headers (before the empty line)
+	static void AddValidators(const HTTPResponse& cached, std::string& headers);
+
+private:
+	struct Entry {
+		std::string key;
+		std::shared_ptr<const HTTPResponse> response;
+		size_t size;
+	};
+
+	void Evict(size_t max_bytes);
+
+	size_t _max_bytes;
+	size_t _size;
+	// most recently used first
+	std::list<Entry> _entries;
+	std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+};
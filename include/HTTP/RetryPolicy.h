@@ -0,0 +1,52 @@
+#pragma once
+
+#include <HTTP/Response.h>
+#include <Errors.h>
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <string_view>
+
+// decides whether a failed request is sent again and after how long: socket errors and
+// 429 / 5xx responses are retried with exponential backoff and full jitter (so clients that
+// failed together don't come back together), or after the server's Retry-After
+class RetryPolicy
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	RetryPolicy();
+
+	// 0 disables retrying
+	void SetMaxRetries(int max_retries);
+	// the n-th retry waits a random time up to min(max, base * 2^n)
+	void SetBackoff(Clock::duration base, Clock::duration max);
+	// a Retry-After longer than this isn't waited for, the response is returned instead
+	void SetMaxRetryAfter(Clock::duration max);
+	// non idempotent requests (eg: POST) may be processed twice when retried, so they aren't by default
+	void SetRetryNonIdempotent(bool enable);
+
+	// `retries` is how many times the request was retried already; `response` is nullptr if it
+	// failed with `err`; on true the request should be sent again after `delay`
+	bool ShouldRetry(const std::string& method, int retries, ECode err, const HTTPResponse* response, Clock::duration& delay);
+
+	static bool IsIdempotent(const std::string& method);
+	// delta-seconds or an HTTP-date
+	static bool ParseRetryAfter(std::string_view value, Clock::duration& delay);
+
+private:
+	Clock::duration GetBackoff(int retries);
+
+	int _max_retries;
+	Clock::duration _base;
+	Clock::duration _max;
+	Clock::duration _max_retry_after;
+	bool _retry_non_idempotent;
+
+	std::mt19937 _random;
+
+	static constexpr std::chrono::milliseconds BASE_DELAY{ 200 };
+	static constexpr std::chrono::seconds MAX_DELAY{ 5 };
+	static constexpr std::chrono::seconds MAX_RETRY_AFTER{ 30 };
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <HTTP/Transport.h>
+#include <HTTP/EventLoop.h>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// the plain socket path: operations are tried right away and finished when
+// the event loop reports the socket ready
+class SocketTransport : public Transport
+{
+public:
+	SocketTransport() = default;
+
+	Kind GetKind() const override;
+
+	SOCKET Socket(int family) override;
+	bool Add(SOCKET sockfd, Handler* handler) override;
+	void Remove(SOCKET sockfd) override;
+
+	bool Connect(SOCKET sockfd, const SysAddress& address) override;
+	bool Send(SOCKET sockfd, const SysIoVec* iov, size_t count) override;
+	bool Recv(SOCKET sockfd, char* buffer, size_t len) override;
+
+	int Poll(int timeout_ms) override;
+	size_t GetCount() const override;
+
+private:
+	enum class Op {
+		CONNECT,
+		SEND,
+		RECV
+	};
+
+	struct Entry : public EventLoop::Handler {
+		SocketTransport* owner;
+		SOCKET sockfd;
+		uint64_t id;
+		Transport::Handler* handler;
+
+		bool connecting;
+		std::vector<SysIoVec> send_iov;
+		char* recv_buffer;
+		size_t recv_len;
+
+		void OnEvent(int events) override;
+	};
+
+	// results of operations that finished right away, delivered from the next Poll()
+	struct Completion {
+		SOCKET sockfd;
+		uint64_t id;
+		Op op;
+		int result;
+	};
+
+	void UpdateEvents(Entry& entry);
+	void Deliver(const Completion& completion);
+
+	EventLoop _loop;
+	std::unordered_map<SOCKET, std::unique_ptr<Entry>> _entries;
+	std::deque<Completion> _completions;
+	uint64_t _next_id = 1;
+};
@@ -5,17 +5,148 @@
 	#include <WS2tcpip.h>
 
 	#define SYS_SOCKET_ERROR (WSAGetLastError())
+
+	#define SYS_WOULD_BLOCK(err)     ((err) == WSAEWOULDBLOCK)
+	#define SYS_CONNECT_PENDING(err) ((err) == WSAEWOULDBLOCK)
+	#define SYS_SEND_FLAGS           0
+	#define SYS_PEEK_FLAGS           MSG_PEEK
+
+	typedef WSABUF SysIoVec;
+
+	inline bool SysSetNonBlocking(SOCKET sockfd)
+	{
+		u_long mode = 1;
+		return ioctlsocket(sockfd, FIONBIO, &mode) == 0;
+	}
+
+	inline void SysIoVecSet(SysIoVec& iov, const char* data, size_t len)
+	{
+		iov.buf = const_cast<char*>(data);
+		iov.len = static_cast<ULONG>(len);
+	}
+
+	// gathered send, returns the number of bytes sent or SOCKET_ERROR
+	inline int SysSendV(SOCKET sockfd, const SysIoVec* iov, size_t count)
+	{
+		DWORD sent_bytes = 0;
+
+		if (WSASend(sockfd, const_cast<SysIoVec*>(iov), static_cast<DWORD>(count), &sent_bytes, 0, NULL, NULL) == SOCKET_ERROR) {
+			return SOCKET_ERROR;
+		}
+		return static_cast<int>(sent_bytes);
+	}
+
+	// no socketpair() here: the two ends of a loopback TCP connection
+	inline bool SysSocketPair(SOCKET pair[2])
+	{
+		sockaddr_in address{};
+		int length = sizeof(address);
+		bool ok;
+
+		pair[0] = pair[1] = INVALID_SOCKET;
+
+		SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listener == INVALID_SOCKET) {
+			return false;
+		}
+
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		ok = bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+			getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) == 0 &&
+			listen(listener, 1) == 0;
+
+		if (ok) {
+			pair[0] = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			ok = pair[0] != INVALID_SOCKET && connect(pair[0], reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+		}
+		if (ok) {
+			pair[1] = accept(listener, NULL, NULL);
+			ok = pair[1] != INVALID_SOCKET;
+		}
+		closesocket(listener);
+
+		if (!ok) {
+			for (int i = 0; i < 2; ++i) {
+				if (pair[i] != INVALID_SOCKET) {
+					closesocket(pair[i]);
+					pair[i] = INVALID_SOCKET;
+				}
+			}
+		}
+		return ok;
+	}
 #else // LINUX
 	#include <unistd.h>
+	#include <fcntl.h>
+	#include <errno.h>
+	#include <sys/socket.h>
+	#include <sys/epoll.h>
+	#include <sys/uio.h>
 	#include <netinet/ip.h>
 	#include <netdb.h>
 
 	#define SYS_SOCKET_ERROR (errno)
 
+	#define SYS_WOULD_BLOCK(err)     ((err) == EAGAIN || (err) == EWOULDBLOCK)
+	#define SYS_CONNECT_PENDING(err) ((err) == EINPROGRESS)
+	#define SYS_SEND_FLAGS           MSG_NOSIGNAL
+	#define SYS_PEEK_FLAGS           (MSG_PEEK | MSG_DONTWAIT)
+
 	#define INVALID_SOCKET (-1)
 	#define SOCKET_ERROR (-1)
 
 	#define closesocket close
 
 	typedef int SOCKET;
+	typedef struct iovec SysIoVec;
+
+	inline bool SysSetNonBlocking(SOCKET sockfd)
+	{
+		int flags = fcntl(sockfd, F_GETFL, 0);
+		return flags != -1 && fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) != -1;
+	}
+
+	inline void SysIoVecSet(SysIoVec& iov, const char* data, size_t len)
+	{
+		iov.iov_base = const_cast<char*>(data);
+		iov.iov_len = len;
+	}
+
+	// gathered send, returns the number of bytes sent or SOCKET_ERROR
+	inline int SysSendV(SOCKET sockfd, const SysIoVec* iov, size_t count)
+	{
+		msghdr msg{};
+
+		msg.msg_iov = const_cast<SysIoVec*>(iov);
+		msg.msg_iovlen = count;
+		return static_cast<int>(sendmsg(sockfd, &msg, SYS_SEND_FLAGS));
+	}
+
+	// two connected stream sockets
+	inline bool SysSocketPair(SOCKET pair[2])
+	{
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+			pair[0] = pair[1] = INVALID_SOCKET;
+			return false;
+		}
+		return true;
+	}
 #endif
+
+#include <cstring>
+
+// an IPv4 or IPv6 socket address
+struct SysAddress {
+	sockaddr_storage storage;
+	socklen_t length;
+
+	const sockaddr* Get() const { return reinterpret_cast<const sockaddr*>(&storage); }
+	int GetFamily() const { return storage.ss_family; }
+
+	bool operator==(const SysAddress& other) const
+	{
+		return length == other.length && memcmp(&storage, &other.storage, length) == 0;
+	}
+	bool operator!=(const SysAddress& other) const { return !(*this == other); }
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <HTTP/Response.h>
+#include <HTTP/Deadline.h>
+#include <HTTP/System.h>
+#include <Errors.h>
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <memory>
+
+class HTTPConnection;
+
+// one request/response exchange, moved forward by the connection it's queued on
+struct HTTPTransaction
+{
+	enum class State {
+		WAITING,    // no connection available yet
+		BACKOFF,    // failed, waiting to be retried (see RetryPolicy)
+		FOLLOWING,  // an identical request is in flight, this one gets its answer
+		SENDING,
+		RECEIVING,
+		DONE
+	};
+
+	// what the request's time limits apply to (see HTTPDeadline)
+	enum class Phase {
+		CONNECT,    // waiting for a connection / for it to connect
+		SEND,
+		RECV
+	};
+
+	std::string method;
+	std::string path;       // without the query
+
+	// the request goes out in this order, gathered with a single send (see GetIoVecs())
+	std::string request_line;
+	std::shared_ptr<const std::string> static_headers;     // pre-serialized, shared by every request
+	std::shared_ptr<const std::string> cookie_header;      // same, rebuilt only when the cookies change
+	std::string headers;                                    // per request headers + the empty line
+	std::string_view body;                                  // not copied, must outlive the request
+	std::string body_storage;                               // for bodies the caller doesn't keep around
+	size_t sent = 0;
+	HTTPResponse* response = nullptr;
+	// GETs: method + path + query + authorization; `cached` is the copy the request asks to revalidate
+	std::string cache_key;
+	std::shared_ptr<const HTTPResponse> cached;
+	// GETs: method + path + query + authorization, identical requests in flight share one
+	std::string flight_key;
+	HTTPConnection* connection = nullptr;
+
+	State state = State::WAITING;
+	ECode result = ECode::OK;
+
+	// may share a connection with other requests in flight
+	bool pipelinable = false;
+	// failed without being answered on a connection that worked before, safe to resend
+	bool retryable = false;
+	int attempts = 0;
+	int retries = 0;        // sent again because of the retry policy
+
+	HTTPDeadline deadline;
+	HTTPDeadline::Clock::time_point started;
+	Phase phase = Phase::CONNECT;
+	HTTPDeadline::Clock::time_point phase_started;
+
+	// the status line and headers are parsed, the body may still be on its way
+	std::function<void(HTTPTransaction&)> on_headers;
+	std::function<void(HTTPTransaction&)> on_complete;
+
+	size_t GetSize() const;
+	// the parts of the request that weren't sent yet, at most `max`; returns how many
+	size_t GetIoVecs(SysIoVec* iov, size_t max) const;
+};
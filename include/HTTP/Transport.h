@@ -0,0 +1,51 @@
+#pragma once
+
+#include <HTTP/System.h>
+
+#include <memory>
+
+// asynchronous socket operations: every Connect / Send / Recv gets exactly one
+// completion, delivered to the socket's handler from Poll()
+class Transport
+{
+public:
+	enum class Kind {
+		SOCKETS,    // non-blocking sockets + epoll / WSAPoll
+		IO_URING    // batched submissions through io_uring (Linux only)
+	};
+
+	class Handler
+	{
+	public:
+		virtual ~Handler() = default;
+
+		// `result` is the number of bytes (or 0 for connect) on success, -sockerr on failure
+		virtual void OnConnect(int result) = 0;
+		virtual void OnSend(int result) = 0;
+		virtual void OnRecv(int result) = 0;
+	};
+
+	virtual ~Transport() = default;
+
+	// falls back to Kind::SOCKETS if `kind` isn't available on this system
+	static std::unique_ptr<Transport> Create(Kind kind);
+
+	virtual Kind GetKind() const = 0;
+
+	// a TCP socket for addresses of `family` (AF_INET / AF_INET6)
+	virtual SOCKET Socket(int family) = 0;
+	virtual bool Add(SOCKET sockfd, Handler* handler) = 0;
+	// once it returns, buffers passed for `sockfd` aren't touched and its handler isn't called anymore
+	virtual void Remove(SOCKET sockfd) = 0;
+
+	// at most one operation of each type can be in flight per socket
+	virtual bool Connect(SOCKET sockfd, const SysAddress& address) = 0;
+	// gathered send; the iovec array is copied, the buffers it points to must stay valid until OnSend()
+	virtual bool Send(SOCKET sockfd, const SysIoVec* iov, size_t count) = 0;
+	virtual bool Recv(SOCKET sockfd, char* buffer, size_t len) = 0;
+
+	// waits at most `timeout_ms` (-1 = forever) and dispatches the completions,
+	// returns the number of completions or -1 on error
+	virtual int Poll(int timeout_ms) = 0;
+	virtual size_t GetCount() const = 0;
+};
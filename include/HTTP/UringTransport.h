@@ -0,0 +1,113 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <HTTP/Transport.h>
+
+#include <linux/io_uring.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// operations are queued as io_uring submissions and handed to the kernel in one
+// io_uring_enter per Poll(), however many requests are in flight
+class UringTransport : public Transport
+{
+public:
+	UringTransport();
+	UringTransport(const UringTransport&) = delete;
+	UringTransport& operator=(const UringTransport&) = delete;
+	~UringTransport();
+
+	// false if the kernel has no (usable) io_uring
+	bool Init(unsigned entries = QUEUE_DEPTH);
+
+	Kind GetKind() const override;
+
+	SOCKET Socket(int family) override;
+	bool Add(SOCKET sockfd, Handler* handler) override;
+	void Remove(SOCKET sockfd) override;
+
+	bool Connect(SOCKET sockfd, const SysAddress& address) override;
+	bool Send(SOCKET sockfd, const SysIoVec* iov, size_t count) override;
+	bool Recv(SOCKET sockfd, char* buffer, size_t len) override;
+
+	int Poll(int timeout_ms) override;
+	size_t GetCount() const override;
+
+private:
+	enum Op : uint8_t {
+		OP_CONNECT,
+		OP_SEND,
+		OP_RECV,
+		OP_CANCEL,
+		OP_TIMEOUT,
+		OP_TIMEOUT_REMOVE
+	};
+
+	struct Entry {
+		uint64_t id;
+		Handler* handler;
+		uint64_t ops[3];    // user_data of the connect / send / recv in flight, 0 if none
+	};
+
+	struct Operation {
+		SOCKET sockfd;
+		uint64_t entry_id;
+		Op op;
+		bool reaped;        // completion taken off the ring, not dispatched yet
+		SysAddress address;
+		msghdr msg;
+		std::vector<iovec> iov;
+		char* buffer;
+		size_t len;
+	};
+
+	struct Completion {
+		uint64_t user_data;
+		int result;
+	};
+
+	io_uring_sqe* Queue(SOCKET sockfd, uint64_t entry_id, Op op, uint64_t& user_data);
+	// `timeout` bounds the wait (needs _ext_arg)
+	int Enter(unsigned min_complete, const __kernel_timespec* timeout = nullptr);
+	void Reap(std::vector<Completion>& completions);
+	bool Dispatch(const Completion& completion);
+
+	int _ring_fd;
+
+	void* _sq_ring;
+	void* _cq_ring;
+	size_t _sq_ring_size;
+	size_t _cq_ring_size;
+	io_uring_sqe* _sqes;
+	size_t _sqes_size;
+
+	unsigned* _sq_head;
+	unsigned* _sq_tail;
+	unsigned* _sq_mask;
+	unsigned* _sq_array;
+	unsigned _sq_entries;
+	unsigned _sqe_tail;
+	unsigned _to_submit;
+
+	unsigned* _cq_head;
+	unsigned* _cq_tail;
+	unsigned* _cq_mask;
+	io_uring_cqe* _cqes;
+
+	std::unordered_map<SOCKET, Entry> _entries;
+	std::unordered_map<uint64_t, Operation> _ops;
+	std::vector<Completion> _deferred;
+	uint64_t _next_id;
+	__kernel_timespec _timeout;
+	// io_uring_enter can bound the wait itself (5.11+); older kernels get an IORING_OP_TIMEOUT,
+	// `_timeout_op` is the one still armed (0 if none)
+	bool _ext_arg;
+	uint64_t _timeout_op;
+
+	static constexpr unsigned QUEUE_DEPTH = 256;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <HTTP/Transport.h>
+#include <HTTP/System.h>
+
+#include <atomic>
+
+// interrupts the transport's Poll() from another thread: a read is always pending on
+// one end of a socket pair, Wake() writes a byte to the other
+class Waker : public Transport::Handler
+{
+public:
+	Waker();
+	Waker(const Waker&) = delete;
+	Waker& operator=(const Waker&) = delete;
+	~Waker();
+
+	// registers with `transport`, leaving the one it was registered with before
+	bool Attach(Transport& transport);
+	void Detach();
+
+	// from any thread; wakeups sent before the poll noticed the first one are merged into it
+	void Wake();
+
+	void OnConnect(int result) override;
+	void OnSend(int result) override;
+	void OnRecv(int result) override;
+
+private:
+	Transport* _transport;
+	SOCKET _sockets[2];     // read end, write end
+	char _buffer[16];
+	std::atomic<bool> _signaled;
+};
@@ -7,7 +7,17 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <functional>
+#include <mutex>
+// fmt 6 captures `this` through [=], deprecated since C++20
+#ifdef __GNUC__
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wdeprecated"
+#endif
 #include <fmt/format.h>
+#ifdef __GNUC__
+	#pragma GCC diagnostic pop
+#endif
 
 #ifdef ENABLE_LOGGING
 	#define LOG_DEBUG(format, ...) \
@@ -50,18 +60,33 @@ public:
 	bool SetOutputToFile(bool enable, int rules = RULE_ALL, const std::string& filename = "chess_debug");
 	bool SetOutputToStdout(bool enable, int rules = RULE_ALL);
 	bool SetOutputToDebugger(bool enable, int rules = RULE_ALL);
+	// while set, what the calling thread would print to stdout is appended to `buffer` instead
+	void SetCapture(std::string* buffer);
+	// while set, what's not captured goes to `sink` instead of stdout (eg: the prompt's printer)
+	void SetStdoutSink(std::function<void(const std::string&)> sink);
 
 	template <typename... Args>
 	void Log(int rule, const char *format, const Args& ... args) {
 		std::string message = fmt::vformat(format, fmt::make_format_args(args...));
 		std::string final = fmt::format("{}{}\n", GetRulePrefix(rule), message);
 
+		// background threads (eg: HTTPRefresher) log too
+		std::lock_guard<std::mutex> lock(_mutex);
+
 		if (_outputToFile && (_outputToFileRules & rule)) {
 			_outputFile << final;
 			_outputFile.flush();
 		}
 		if (_outputToStdout && (_outputToStdoutRules & rule)) {
-			std::cout << final;
+			if (_capture) {
+				_capture->append(final);
+			}
+			else if (_stdoutSink) {
+				_stdoutSink(final);
+			}
+			else {
+				std::cout << final;
+			}
 		}
 #ifdef _WIN32
 		if (_outputToDebugger && (_outputToDebuggerRules & rule)) {
@@ -80,6 +105,11 @@ private:
 	bool _outputToDebugger;
 	int _outputToDebuggerRules;
 
+	std::function<void(const std::string&)> _stdoutSink;
+
 	std::ofstream _outputFile;
+	std::mutex _mutex;
+
+	static thread_local std::string* _capture;
 };
 
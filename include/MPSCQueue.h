@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// unbounded queue, any number of threads push, one thread pops; neither side takes a lock
+// (a linked list whose last node is swapped in atomically by the producers)
+template <typename T>
+class MPSCQueue
+{
+public:
+	MPSCQueue() : _head(new Node), _tail(_head.load()) {}
+	MPSCQueue(const MPSCQueue&) = delete;
+	MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+	~MPSCQueue()
+	{
+		T value;
+		while (Pop(value)) {
+		}
+		delete _tail;
+	}
+
+	void Push(T value)
+	{
+		Node* node = new Node;
+		node->value = std::move(value);
+
+		Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	// consumer only; false when empty (or when the next push isn't linked in yet)
+	bool Pop(T& value)
+	{
+		Node* next = _tail->next.load(std::memory_order_acquire);
+		if (!next) {
+			return false;
+		}
+
+		// `next` becomes the new dummy node, its value is taken out
+		value = std::move(next->value);
+		delete _tail;
+		_tail = next;
+		return true;
+	}
+
+private:
+	struct Node {
+		std::atomic<Node*> next{ nullptr };
+		T value;
+	};
+
+	std::atomic<Node*> _head;  // last pushed
+	Node* _tail;               // dummy node before the next one to pop
+};
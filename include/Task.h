@@ -0,0 +1,193 @@
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+template <typename T = void>
+class Task;
+
+namespace TaskDetail
+{
+	struct PromiseBase {
+		// who co_await'ed the task, resumed when it's done
+		std::coroutine_handle<> continuation = std::noop_coroutine();
+
+		struct FinalAwaiter {
+			bool await_ready() noexcept { return false; }
+			template <typename Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+			{
+				return handle.promise().continuation;
+			}
+			void await_resume() noexcept {}
+		};
+
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		FinalAwaiter final_suspend() noexcept { return {}; }
+		// errors are ECodes here, nothing is expected to throw
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+
+	template <typename T>
+	struct Promise : PromiseBase {
+		std::optional<T> value;
+
+		Task<T> get_return_object() noexcept;
+		template <typename U>
+		void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+		T TakeResult() { return std::move(*value); }
+	};
+
+	template <>
+	struct Promise<void> : PromiseBase {
+		Task<void> get_return_object() noexcept;
+		void return_void() noexcept {}
+		void TakeResult() noexcept {}
+	};
+
+	// runs a task to the end with nobody waiting for it, then frees itself
+	struct Detached {
+		struct promise_type {
+			Detached get_return_object() noexcept { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() noexcept {}
+			void unhandled_exception() noexcept { std::terminate(); }
+		};
+	};
+}
+
+// a coroutine that starts when co_await'ed (or handed to Spawn()); it runs on whichever thread
+// resumes it, eg: the one finishing an HTTP request it waits for (see HTTPClient::GetAwait()),
+// unless it's waited for by SyncWait()
+template <typename T>
+class Task
+{
+public:
+	using promise_type = TaskDetail::Promise<T>;
+
+	Task(Task&& other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+	Task& operator=(Task&&) = delete;
+
+	~Task()
+	{
+		if (_handle) {
+			_handle.destroy();
+		}
+	}
+
+	auto operator co_await() noexcept
+	{
+		struct Awaiter {
+			std::coroutine_handle<promise_type> handle;
+
+			bool await_ready() noexcept { return handle.done(); }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+			{
+				handle.promise().continuation = awaiting;
+				return handle;
+			}
+			T await_resume() { return handle.promise().TakeResult(); }
+		};
+		return Awaiter{ _handle };
+	}
+
+private:
+	friend promise_type;
+	explicit Task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+
+	std::coroutine_handle<promise_type> _handle;
+};
+
+template <typename T>
+Task<T> TaskDetail::Promise<T>::get_return_object() noexcept
+{
+	return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskDetail::Promise<void>::get_return_object() noexcept
+{
+	return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// the coroutines run by SyncWait() are resumed on the thread waiting for them: what they wait for
+// posts them here instead of resuming them where it completes
+class ResumeQueue
+{
+public:
+	// the queue of the calling thread, nullptr unless it's in SyncWait()
+	static ResumeQueue*& Current()
+	{
+		static thread_local ResumeQueue* current = nullptr;
+		return current;
+	}
+
+	// notified under the lock: once the last coroutine runs, the queue may be gone
+	void Post(std::coroutine_handle<> handle)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_handles.push_back(handle);
+		_cond.notify_all();
+	}
+
+	void Finish()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_finished = true;
+		_cond.notify_all();
+	}
+
+	// resumes what's posted, on the calling thread, until Finish()
+	void Run()
+	{
+		while (true) {
+			std::unique_lock<std::mutex> lock(_mutex);
+			_cond.wait(lock, [this] { return _finished || !_handles.empty(); });
+			if (_handles.empty()) {
+				return;
+			}
+
+			std::coroutine_handle<> handle = _handles.front();
+			_handles.pop_front();
+			lock.unlock();
+			handle.resume();
+		}
+	}
+
+private:
+	std::mutex _mutex;
+	std::condition_variable _cond;
+	std::deque<std::coroutine_handle<>> _handles;
+	bool _finished = false;
+};
+
+// starts the task on the calling thread and returns at its first suspension,
+// `on_done` is called where it ends
+inline TaskDetail::Detached Spawn(Task<> task, std::function<void()> on_done = nullptr)
+{
+	co_await task;
+
+	if (on_done) {
+		on_done();
+	}
+}
+
+// runs the task on the calling thread, which blocks whenever the task waits for something
+inline void SyncWait(Task<> task)
+{
+	ResumeQueue queue;
+	ResumeQueue* previous = std::exchange(ResumeQueue::Current(), &queue);
+
+	Spawn(std::move(task), [&queue] { queue.Finish(); });
+	queue.Run();
+
+	ResumeQueue::Current() = previous;
+}
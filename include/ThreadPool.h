@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed number of workers, each with a queue of its own; a worker takes the newest job from its
+// queue and, once it's empty, steals the oldest one from the others; jobs submitted from outside
+// are spread round robin, the ones submitted by a job go to the queue of its worker
+class ThreadPool
+{
+public:
+	using Job = std::function<void()>;
+
+	explicit ThreadPool(size_t workers);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	// the jobs already submitted still run
+	~ThreadPool();
+
+	void Submit(Job job);
+	// blocks until every job submitted so far is done
+	void WaitIdle();
+	size_t GetPending() const;
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+		std::thread thread;
+	};
+
+	void Work(size_t index);
+	bool Take(size_t index, Job& job);
+
+	std::vector<std::unique_ptr<Worker>> _workers;
+	std::atomic<size_t> _next;
+	// jobs in the queues (briefly negative when one is taken before it's counted) /
+	// submitted and not done yet
+	std::atomic<int> _queued;
+	std::atomic<size_t> _pending;
+
+	std::mutex _mutex;
+	std::condition_variable _work_cond;
+	std::condition_variable _idle_cond;
+	bool _stop;
+};
@@ -2,10 +2,12 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 
 namespace Utils
 {
 	std::vector<std::string> Split(const std::string& str, const std::string& delim);
 	std::string Trim(const std::string& str, const std::string& whitespace = " \t");
 	std::string ToLower(const std::string& str);
+	bool EqualsNoCase(std::string_view a, std::string_view b);
 }
@@ -1,8 +1,13 @@
 #include <App.h>
 #include <Logger.h>
+#include <Utils.h>
 
 #include <nlohmann/json.hpp>
 
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+
 using json = nlohmann::json;
 
 Application& Application::GetInstance()
@@ -12,7 +17,9 @@ Application& Application::GetInstance()
 }
 
 Application::Application() :
-	_running(true), _client(SERVER_HOST, SERVER_PORT)
+	_running(true), _client(SERVER_HOST, SERVER_PORT),
+	_books(_client, "/api/v1/tema/library/books", BOOKS_REFRESH_INTERVAL),
+	_refresh_books(BOOKS_REFRESH_INTERVAL.count() > 0), _cmd_proc(COMMAND_WORKERS)
 {
 
 }
@@ -27,10 +34,58 @@ ECode Application::Startup()
 		return err;
 	}
 
-	err = _client.ResolveHost();
-	if (err != ECode::OK) {
-		LOG_ERROR("Couldn't resolve host, errcode: {}", err);
-		return err;
+	// the prompt doesn't wait for the lookup, the first command does if it's still running
+	_client.ResolveHostAsync();
+	_client.SetKeepAlive(true);
+
+	HTTPDeadline deadline;
+	deadline.connect = REQUEST_CONNECT_TIMEOUT;
+	deadline.send = REQUEST_SEND_TIMEOUT;
+	deadline.recv = REQUEST_RECV_TIMEOUT;
+	_client.SetDeadline(deadline);
+	InstallInterruptHandler();
+
+	// GET / DELETE only: a repeated register / login / add_book could be processed twice
+	RetryPolicy retry_policy;
+	retry_policy.SetMaxRetries(REQUEST_MAX_RETRIES);
+	_client.SetRetryPolicy(retry_policy);
+
+	// the same get_book asked for again while the first one is still on its way isn't sent twice
+	_client.SetCoalescing(true);
+
+	// get_books / get_book download the books again only if they changed
+	_client.SetResponseCacheSize(RESPONSE_CACHE_BYTES);
+
+	// if the server is down, commands fail right away instead of each one waiting to time out
+	CircuitBreaker breaker;
+	breaker.AddEndpoint("/api/v1/tema/auth");
+	breaker.AddEndpoint("/api/v1/tema/library");
+	_client.SetCircuitBreaker(breaker);
+
+	// get_books / get_book send a second copy when the first one is slower than usual
+	if (const char* hedge = std::getenv("HTTP_HEDGE"); hedge && std::string(hedge) == "1") {
+		HedgePolicy hedge_policy;
+		hedge_policy.SetEnabled(true);
+		hedge_policy.AddPath("/api/v1/tema/library/books");
+		_client.SetHedgePolicy(hedge_policy);
+	}
+
+	if (const char* transport = std::getenv("HTTP_TRANSPORT"); transport && std::string(transport) == "io_uring") {
+		_client.SetTransport(Transport::Kind::IO_URING);
+	}
+
+	// seconds between background refreshes of the book list, 0 turns them off
+	if (const char* refresh = std::getenv("HTTP_BOOKS_REFRESH"); refresh) {
+		std::chrono::seconds interval{ std::atoi(refresh) };
+		_refresh_books = interval.count() > 0;
+		_books.SetInterval(interval);
+	}
+
+	// one thread moves every request forward, the prompt and the book refresher only wait for theirs
+	_client.StartEngine();
+
+	if (PREWARM_CONNECTIONS && _client.Prewarm(PREWARM_CONNECTIONS) == 0) {
+		LOG_WARNING("Couldn't pre-connect to the server, will connect on first command.");
 	}
 
 	err = RegisterCommands();
@@ -50,37 +105,78 @@ ECode Application::Run()
 	return ECode::OK;
 }
 
+void Application::InstallInterruptHandler()
+{
+#ifdef _WIN32
+	SetConsoleCtrlHandler([](DWORD type) -> BOOL {
+		if (type != CTRL_C_EVENT || !GetInstance()._cmd_proc.CancelForeground()) {
+			return FALSE;
+		}
+		return TRUE;
+	}, TRUE);
+#else
+	struct sigaction action {};
+
+	// SA_RESTART: reading the prompt goes on, waiting for the network wakes up (EINTR)
+	action.sa_flags = SA_RESTART;
+	action.sa_handler = [](int sig) {
+		if (!GetInstance()._cmd_proc.CancelForeground()) {
+			signal(sig, SIG_DFL);
+			raise(sig);
+		}
+	};
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, nullptr);
+#endif
+}
+
+HTTPDeadline Application::GetDeadline(CancelToken& cancel) const
+{
+	HTTPDeadline deadline = _client.GetDeadline();
+	deadline.cancel = &cancel;
+	return deadline;
+}
+
 ECode Application::Shutdown()
 {
+	_cmd_proc.WaitBackground();
+	_books.Stop();
+	_client.StopEngine();
+	_client.Close();
 	return HTTPClient::GlobalShutdown();
 }
 
-#define REGISTER(name, ...) _cmd_proc.Register(#name, {__VA_ARGS__}, std::bind(&Application::CMD_ ## name, this, std::placeholders::_1))
+#define REGISTER(name, ...) _cmd_proc.Register(#name, {__VA_ARGS__}, std::bind(&Application::CMD_ ## name, this, std::placeholders::_1, std::placeholders::_2))
+// the prompt comes back before these are done (they only read the session)
+#define REGISTER_BACKGROUND(name, ...) _cmd_proc.Register(#name, {__VA_ARGS__}, std::bind(&Application::CMD_ ## name, this, std::placeholders::_1, std::placeholders::_2), true)
+#define REGISTER_TASK(name, ...) _cmd_proc.RegisterTask(#name, {__VA_ARGS__}, std::bind(&Application::CMD_ ## name, this, std::placeholders::_1, std::placeholders::_2))
+#define REGISTER_TASK_BACKGROUND(name, ...) _cmd_proc.RegisterTask(#name, {__VA_ARGS__}, std::bind(&Application::CMD_ ## name, this, std::placeholders::_1, std::placeholders::_2), true)
 ECode Application::RegisterCommands()
 {
 	ECode err;
 
 	err = REGISTER(Register,    "username", "password"); if (err != ECode::OK) return err;
-	err = REGISTER(Login,       "username", "password"); if (err != ECode::OK) return err;
+	err = REGISTER_TASK(Login,  "username", "password"); if (err != ECode::OK) return err;
 	err = REGISTER(Logout);                              if (err != ECode::OK) return err;
 	err = REGISTER(Exit);                                if (err != ECode::OK) return err;
 
-	err = REGISTER(Enter_Library);                       if (err != ECode::OK) return err;
-	err = REGISTER(Get_Books);                           if (err != ECode::OK) return err;
-	err = REGISTER(Get_Book,    "id");                   if (err != ECode::OK) return err;
+	err = REGISTER_TASK(Enter_Library);                  if (err != ECode::OK) return err;
+	err = REGISTER_TASK_BACKGROUND(Get_Books);           if (err != ECode::OK) return err;
+	err = REGISTER_BACKGROUND(Get_Book, "id");           if (err != ECode::OK) return err;
 	err = REGISTER(Add_Book,    "title", "author", "genre", "publisher", "page_count"); if (err != ECode::OK) return err;
 	err = REGISTER(Delete_Book, "id");                   if (err != ECode::OK) return err;
 
 	return ECode::OK;
 }
 
-void Application::CMD_Register(SMap& prompts)
+void Application::CMD_Register(SMap& prompts, CancelToken& cancel)
 {
+	HTTPDeadline deadline = GetDeadline(cancel);
 	json body(prompts);
 	HTTPResponse response;
 	ECode err;
 
-	err = _client.Post(response, "/api/v1/tema/auth/register", SMap(), body.dump(), "application/json");
+	err = _client.Post(response, "/api/v1/tema/auth/register", SMap(), body.dump(), "application/json", SMap(), SMap(), &deadline);
 	if (err != ECode::OK) {
 		LOG_ERROR("HTTP POST failed, errcode: {}", err);
 		return;
@@ -89,7 +185,7 @@ void Application::CMD_Register(SMap& prompts)
 	if (response.GetCode() != 201) {
 		std::string error;
 		try {
-			error = json::parse(response.GetData())["error"];
+			error = json::parse(response.GetBody())["error"];
 		}
 		catch (...) {
 			error = "--no error object--";
@@ -103,22 +199,21 @@ void Application::CMD_Register(SMap& prompts)
 	LOG_MESSAGE("Account registered!");
 }
 
-void Application::CMD_Login(SMap& prompts)
+Task<> Application::CMD_Login(SMap& prompts, CancelToken& cancel)
 {
+	HTTPDeadline deadline = GetDeadline(cancel);
 	json body(prompts);
-	HTTPResponse response;
-	ECode err;
 
-	err = _client.Post(response, "/api/v1/tema/auth/login", SMap(), body.dump(), "application/json");
+	auto [err, response] = co_await _client.PostAwait("/api/v1/tema/auth/login", SMap(), body.dump(), "application/json", SMap(), SMap(), &deadline);
 	if (err != ECode::OK) {
 		LOG_ERROR("HTTP POST failed, errcode: {}", err);
-		return;
+		co_return;
 	}
 
 	if (response.GetCode() != 200) {
 		std::string error;
 		try {
-			error = json::parse(response.GetData())["error"];
+			error = json::parse(response.GetBody())["error"];
 		}
 		catch (...) {
 			if (response.GetCode() == 204) {
@@ -131,18 +226,21 @@ void Application::CMD_Login(SMap& prompts)
 
 		LOG_ERROR("Can't log in!");
 		LOG_ERROR("Response: {} {} - {}", response.GetCode(), response.GetStatus(), error);
-		return;
+		co_return;
 	}
 
+	// whatever was cached belongs to the previous user
+	_client.ClearResponseCache();
 	LOG_MESSAGE("Logged in!");
 }
 
-void Application::CMD_Logout(SMap&)
+void Application::CMD_Logout(SMap&, CancelToken& cancel)
 {
+	HTTPDeadline deadline = GetDeadline(cancel);
 	HTTPResponse response;
 	ECode err;
 
-	err = _client.Get(response, "/api/v1/tema/auth/logout");
+	err = _client.Get(response, "/api/v1/tema/auth/logout", SMap(), SMap(), SMap(), &deadline);
 	if (err != ECode::OK) {
 		LOG_ERROR("HTTP GET failed, errcode: {}", err);
 		return;
@@ -151,7 +249,7 @@ void Application::CMD_Logout(SMap&)
 	if (response.GetCode() != 200) {
 		std::string error;
 		try {
-			error = json::parse(response.GetData())["error"];
+			error = json::parse(response.GetBody())["error"];
 		}
 		catch (...) {
 			error = "--no error object--";
@@ -164,27 +262,29 @@ void Application::CMD_Logout(SMap&)
 
 	_user_headers.clear();
 	_client.ClearCookies();
+	_client.ClearResponseCache();
+	_books.Stop();
+	_books.SetHeaders(_user_headers);
 	LOG_MESSAGE("Logged out!");
 }
 
-void Application::CMD_Exit(SMap&)
+void Application::CMD_Exit(SMap&, CancelToken&)
 {
 	_running = false;
 }
 
-void Application::CMD_Enter_Library(SMap&)
+Task<> Application::CMD_Enter_Library(SMap&, CancelToken& cancel)
 {
+	HTTPDeadline deadline = GetDeadline(cancel);
 	json body;
-	HTTPResponse response;
-	ECode err;
 
-	err = _client.Get(response, "/api/v1/tema/library/access");
+	auto [err, response] = co_await _client.GetAwait("/api/v1/tema/library/access", SMap(), SMap(), SMap(), &deadline);
 	if (err != ECode::OK) {
 		LOG_ERROR("HTTP GET failed, errcode: {}", err);
-		return;
+		co_return;
 	}
 
-	body = json::parse(response.GetData(), nullptr, false);
+	body = json::parse(response.GetBody(), nullptr, false);
 	if (response.GetCode() != 200) {
 		std::string error = "--no error object--";
 		if (body.count("error")) {
@@ -193,26 +293,41 @@ void Application::CMD_Enter_Library(SMap&)
 
 		LOG_ERROR("Can't enter library!");
 		LOG_ERROR("Response: {} {} - {}", response.GetCode(), response.GetStatus(), error);
-		return;
+		co_return;
 	}
 
 	_user_headers["authorization"] = fmt::format("Bearer {}", body["token"]);
+	if (_refresh_books) {
+		_books.SetHeaders(_user_headers);
+		_books.Start();
+	}
 	LOG_MESSAGE("Entered library!");
 }
 
-void Application::CMD_Get_Books(SMap&)
+Task<> Application::CMD_Get_Books(SMap&, CancelToken& cancel)
 {
+	HTTPDeadline deadline = GetDeadline(cancel);
 	json body;
-	HTTPResponse response;
-	ECode err;
 
-	err = _client.Get(response, "/api/v1/tema/library/books", {}, _user_headers);
+	// the last background refresh, if there was one
+	auto snapshot = _books.GetSnapshot();
+	if (snapshot) {
+		auto age = std::chrono::duration_cast<std::chrono::seconds>(snapshot->GetAge());
+
+		body = json::parse(snapshot->response.GetBody(), nullptr, false);
+		LOG_MESSAGE("{}", body.dump(2));
+		LOG_MESSAGE("(as of {}s ago, refreshed every {}s)", age.count(),
+			std::chrono::duration_cast<std::chrono::seconds>(_books.GetInterval()).count());
+		co_return;
+	}
+
+	auto [err, response] = co_await _client.GetAwait("/api/v1/tema/library/books", SMap(), _user_headers, SMap(), &deadline);
 	if (err != ECode::OK) {
 		LOG_ERROR("HTTP GET failed, errcode: {}", err);
-		return;
+		co_return;
 	}
 
-	body = json::parse(response.GetData(), nullptr, false);
+	body = json::parse(response.GetBody(), nullptr, false);
 	if (response.GetCode() != 200) {
 		std::string error = "--no error object--";
 		if (body.count("error")) {
@@ -221,41 +336,58 @@ void Application::CMD_Get_Books(SMap&)
 
 		LOG_ERROR("Can't retrieve books!");
 		LOG_ERROR("Response: {} {} - {}", response.GetCode(), response.GetStatus(), error);
-		return;
+		co_return;
 	}
 
 	LOG_MESSAGE("{}", body.dump(2));
 }
 
-void Application::CMD_Get_Book(SMap& prompts)
+void Application::CMD_Get_Book(SMap& prompts, CancelToken& cancel)
 {
-	json body;
-	HTTPResponse response;
-	ECode err;
-
-	err = _client.Get(response, fmt::format("/api/v1/tema/library/books/{}", prompts["id"]), {}, _user_headers);
-	if (err != ECode::OK) {
-		LOG_ERROR("HTTP GET failed, errcode: {}", err);
+	HTTPDeadline deadline = GetDeadline(cancel);
+	std::vector<std::string> ids;
+	std::vector<std::future<HTTPClient::Result>> books;
+
+	// several ids (eg: "1 2 3") are asked for all at once and printed in order
+	for (const auto& id : Utils::Split(prompts["id"], " ")) {
+		if (!id.empty()) {
+			ids.push_back(id);
+			books.push_back(_client.GetAsync(fmt::format("/api/v1/tema/library/books/{}", id), {}, _user_headers, SMap(), &deadline));
+		}
+	}
+	if (ids.empty()) {
+		LOG_ERROR("Empty id.");
 		return;
 	}
 
-	body = json::parse(response.GetData(), nullptr, false);
-	if (response.GetCode() != 200) {
-		std::string error = "--no error object--";
-		if (body.count("error")) {
-			error = body["error"];
+	for (size_t i = 0; i < books.size(); ++i) {
+		HTTPClient::Result result = books[i].get();
+		const HTTPResponse& response = result.response;
+
+		if (result.err != ECode::OK) {
+			LOG_ERROR("HTTP GET failed for book {}, errcode: {}", ids[i], result.err);
+			continue;
 		}
 
-		LOG_ERROR("Can't retrieve book!");
-		LOG_ERROR("Response: {} {} - {}", response.GetCode(), response.GetStatus(), error);
-		return;
-	}
+		json body = json::parse(response.GetBody(), nullptr, false);
+		if (response.GetCode() != 200) {
+			std::string error = "--no error object--";
+			if (body.count("error")) {
+				error = body["error"];
+			}
 
-	LOG_MESSAGE("{}", body.dump(2));
+			LOG_ERROR("Can't retrieve book {}!", ids[i]);
+			LOG_ERROR("Response: {} {} - {}", response.GetCode(), response.GetStatus(), error);
+			continue;
+		}
+
+		LOG_MESSAGE("{}", body.dump(2));
+	}
 }
 
-void Application::CMD_Add_Book(SMap& prompts)
+void Application::CMD_Add_Book(SMap& prompts, CancelToken& cancel)
 {
+	HTTPDeadline deadline = GetDeadline(cancel);
 	json body(prompts);
 	HTTPResponse response;
 	ECode err;
@@ -271,7 +403,7 @@ void Application::CMD_Add_Book(SMap& prompts)
 		return;
 	}
 
-	err = _client.Post(response, "/api/v1/tema/library/books", SMap(), body.dump(), "application/json", _user_headers);
+	err = _client.Post(response, "/api/v1/tema/library/books", SMap(), body.dump(), "application/json", _user_headers, SMap(), &deadline);
 	if (err != ECode::OK) {
 		LOG_ERROR("HTTP POST failed, errcode: {}", err);
 		return;
@@ -280,7 +412,7 @@ void Application::CMD_Add_Book(SMap& prompts)
 	if (response.GetCode() != 200) {
 		std::string error;
 		try {
-			error = json::parse(response.GetData())["error"];
+			error = json::parse(response.GetBody())["error"];
 		}
 		catch (...) {
 			error = "--no error object--";
@@ -291,22 +423,24 @@ void Application::CMD_Add_Book(SMap& prompts)
 		return;
 	}
 
+	_books.Refresh(true);
 	LOG_MESSAGE("Book added!");
 }
 
-void Application::CMD_Delete_Book(SMap& prompts)
+void Application::CMD_Delete_Book(SMap& prompts, CancelToken& cancel)
 {
+	HTTPDeadline deadline = GetDeadline(cancel);
 	json body;
 	HTTPResponse response;
 	ECode err;
 
-	err = _client.Delete(response, fmt::format("/api/v1/tema/library/books/{}", prompts["id"]), {}, _user_headers);
+	err = _client.Delete(response, fmt::format("/api/v1/tema/library/books/{}", prompts["id"]), {}, _user_headers, SMap(), &deadline);
 	if (err != ECode::OK) {
 		LOG_ERROR("HTTP DELETE failed, errcode: {}", err);
 		return;
 	}
 
-	body = json::parse(response.GetData(), nullptr, false);
+	body = json::parse(response.GetBody(), nullptr, false);
 	if (response.GetCode() != 200) {
 		std::string error = "--no error object--";
 		if (body.count("error")) {
@@ -318,5 +452,6 @@ void Application::CMD_Delete_Book(SMap& prompts)
 		return;
 	}
 
+	_books.Refresh(true);
 	LOG_MESSAGE("Book deleted!");
 }
@@ -4,7 +4,31 @@
 
 #include <iostream>
 
-ECode CmdProc::Register(const std::string& name, const std::list<std::string>& prompts, Callback callback)
+CmdProc::CmdProc(size_t workers) :
+	_queued(0), _printed(0), _stop(false), _at_prompt(false), _workers(workers)
+{
+	_printer = std::thread(&CmdProc::Printer, this);
+
+	// eg: the client's I/O thread logging an error while the prompt waits
+	Logger::GetInstance().SetStdoutSink([this](const std::string& line) {
+		Print(Output::Kind::TEXT, line);
+	});
+}
+
+CmdProc::~CmdProc()
+{
+	_workers.WaitIdle();
+	Logger::GetInstance().SetStdoutSink(nullptr);
+
+	{
+		std::lock_guard<std::mutex> lock(_print_mutex);
+		_stop = true;
+	}
+	_print_cond.notify_all();
+	_printer.join();
+}
+
+ECode CmdProc::Register(const std::string& name, const std::list<std::string>& prompts, Callback callback, bool background)
 {
 	std::string lower_name = Utils::ToLower(name);
 
@@ -15,11 +39,19 @@ ECode CmdProc::Register(const std::string& name, const std::list<std::string>& p
 	Entry e;
 	e.callback = callback;
 	e.prompts = prompts;
+	e.background = background;
 
 	_commands[lower_name] = std::move(e);
 	return ECode::OK;
 }
 
+ECode CmdProc::RegisterTask(const std::string& name, const std::list<std::string>& prompts, TaskCallback callback, bool background)
+{
+	return Register(name, prompts, Callback([callback](SMap& user_response, CancelToken& cancel) {
+		SyncWait(callback(user_response, cancel));
+	}), background);
+}
+
 ECode CmdProc::Unregister(const std::string& name)
 {
 	std::string lower_name = Utils::ToLower(name);
@@ -37,8 +69,9 @@ ECode CmdProc::ProcessNewCommand()
 {
 	std::string cmd_name;
 
-	std::cout << "> ";
+	Print(Output::Kind::PROMPT, "> ");
 	std::getline(std::cin, cmd_name);
+	Print(Output::Kind::INPUT, "");
 	cmd_name = Utils::Trim(Utils::ToLower(cmd_name));
 	
 	if (cmd_name.length() == 0) {
@@ -53,10 +86,125 @@ ECode CmdProc::ProcessNewCommand()
 
 	SMap user_response;
 	for (const auto& prompt : cmd->second.prompts) {
-		std::cout << prompt << "=";
+		Print(Output::Kind::PROMPT, prompt + "=");
 		std::getline(std::cin, user_response[prompt]);
+		Print(Output::Kind::INPUT, "");
+	}
+
+	if (cmd->second.background) {
+		_workers.Submit([this, callback = cmd->second.callback, user_response]() mutable {
+			std::string output;
+			CancelToken cancel;
+
+			// printed in one piece once it's done, not interleaved with the others
+			Logger::GetInstance().SetCapture(&output);
+			callback(user_response, cancel);
+			Logger::GetInstance().SetCapture(nullptr);
+
+			if (!output.empty()) {
+				Print(Output::Kind::TEXT, std::move(output));
+			}
+		});
+		return ECode::OK;
 	}
 
-	cmd->second.callback(user_response);
+	// eg: logging in while get_books runs would change the headers it's using
+	WaitBackground();
+
+	// a Ctrl-C while the prompt was waiting doesn't cancel this one
+	_foreground.Reset();
+	cmd->second.callback(user_response, _foreground);
 	return ECode::OK;
 }
+
+void CmdProc::WaitBackground()
+{
+	_workers.WaitIdle();
+	Flush();
+}
+
+bool CmdProc::CancelForeground()
+{
+	if (!_foreground.IsInUse()) {
+		return false;
+	}
+
+	_foreground.Cancel();
+	return true;
+}
+
+void CmdProc::Print(Output::Kind kind, std::string text)
+{
+	Output output;
+	output.kind = kind;
+	output.text = std::move(text);
+
+	_output.Push(std::move(output));
+	++_queued;
+
+	// the printer either sees the count or gets notified
+	{
+		std::lock_guard<std::mutex> lock(_print_mutex);
+	}
+	_print_cond.notify_all();
+}
+
+void CmdProc::Flush()
+{
+	size_t target = _queued.load();
+
+	std::unique_lock<std::mutex> lock(_print_mutex);
+	_print_cond.wait(lock, [&] { return _printed.load() >= target; });
+}
+
+void CmdProc::Printer()
+{
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(_print_mutex);
+			_print_cond.wait(lock, [this] { return _stop || _printed.load() != _queued.load(); });
+			if (_stop && _printed.load() == _queued.load()) {
+				return;
+			}
+		}
+
+		Output output;
+		size_t printed = 0;
+
+		while (_output.Pop(output)) {
+			switch (output.kind) {
+			case Output::Kind::PROMPT:
+				std::cout << output.text;
+				_at_prompt = true;
+				_prompt = std::move(output.text);
+				break;
+			case Output::Kind::INPUT:
+				_at_prompt = false;
+				break;
+			case Output::Kind::TEXT:
+				// the line being typed stays where it is, the prompt is drawn again below the text
+				if (_at_prompt) {
+					std::cout << '\n' << output.text << _prompt;
+				}
+				else {
+					std::cout << output.text;
+				}
+				break;
+			}
+			++printed;
+		}
+		std::cout.flush();
+
+		if (printed == 0) {
+			// counted, but its producer hasn't linked it in yet
+			std::this_thread::yield();
+			continue;
+		}
+
+		_printed += printed;
+		{
+			std::lock_guard<std::mutex> lock(_print_mutex);
+		}
+		_print_cond.notify_all();
+	}
+}
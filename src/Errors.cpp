@@ -13,6 +13,11 @@ std::ostream &operator<<(std::ostream& os, ECode ec)
     CASE(SOCKET_CONNECT)
     CASE(SOCKET_SEND)
     CASE(SOCKET_RECV)
+    CASE(ABORTED)
+    CASE(BAD_RESPONSE)
+    CASE(TIMED_OUT)
+    CASE(CANCELLED)
+    CASE(CIRCUIT_OPEN)
     CASE(CMD_ALREADYREGISTERED)
     CASE(CMD_NOTREGISTERED)
     CASE(CMD_EMPTY)
@@ -0,0 +1,125 @@
+#include <HTTP/CircuitBreaker.h>
+#include <Logger.h>
+
+#include <algorithm>
+
+CircuitBreaker::CircuitBreaker() :
+	_failure_threshold(FAILURE_THRESHOLD), _open_time(OPEN_TIME)
+{
+}
+
+void CircuitBreaker::AddEndpoint(const std::string& prefix)
+{
+	_endpoints.emplace_back();
+	_endpoints.back().prefix = prefix;
+}
+
+void CircuitBreaker::SetFailureThreshold(int failures)
+{
+	_failure_threshold = std::max(failures, 1);
+}
+
+void CircuitBreaker::SetOpenTime(Clock::duration open_time)
+{
+	_open_time = open_time;
+}
+
+bool CircuitBreaker::Allow(const std::string& path)
+{
+	Endpoint* endpoint = Find(path);
+
+	if (!endpoint) {
+		return true;
+	}
+
+	Update(*endpoint);
+	return endpoint->state == State::CLOSED || (endpoint->state == State::HALF_OPEN && !endpoint->probing);
+}
+
+void CircuitBreaker::OnAttempt(const std::string& path)
+{
+	Endpoint* endpoint = Find(path);
+
+	if (endpoint && endpoint->state == State::HALF_OPEN) {
+		endpoint->probing = true;
+	}
+}
+
+void CircuitBreaker::OnResult(const std::string& path, ECode err, const HTTPResponse* response)
+{
+	Endpoint* endpoint = Find(path);
+
+	if (!endpoint) {
+		return;
+	}
+
+	bool failed;
+	if (response) {
+		failed = response->GetCode() >= 500;
+	}
+	else if (err == ECode::SOCKET_CONNECT || err == ECode::SOCKET_SEND || err == ECode::SOCKET_RECV ||
+		err == ECode::TIMED_OUT || err == ECode::BAD_RESPONSE) {
+		failed = true;
+	}
+	else {
+		// cancelled / aborted, says nothing about the server
+		endpoint->probing = false;
+		return;
+	}
+
+	if (!failed) {
+		if (endpoint->state != State::CLOSED) {
+			LOG_WARNING("Server answers {} again, circuit closed.", endpoint->prefix);
+		}
+		endpoint->state = State::CLOSED;
+		endpoint->failures = 0;
+		endpoint->probing = false;
+		return;
+	}
+
+	++endpoint->failures;
+
+	// a failed probe opens it again right away
+	if (endpoint->state == State::HALF_OPEN ||
+		(endpoint->state == State::CLOSED && endpoint->failures >= _failure_threshold)) {
+		LOG_WARNING("Requests to {} keep failing, circuit open.", endpoint->prefix);
+		endpoint->state = State::OPEN;
+		endpoint->opened = Clock::now();
+	}
+	endpoint->probing = false;
+}
+
+CircuitBreaker::State CircuitBreaker::GetState(const std::string& path)
+{
+	Endpoint* endpoint = Find(path);
+
+	if (!endpoint) {
+		return State::CLOSED;
+	}
+
+	Update(*endpoint);
+	return endpoint->state;
+}
+
+CircuitBreaker::Endpoint* CircuitBreaker::Find(const std::string& path)
+{
+	Endpoint* best = nullptr;
+
+	for (auto& endpoint : _endpoints) {
+		if (path.compare(0, endpoint.prefix.size(), endpoint.prefix) == 0 &&
+			(!best || endpoint.prefix.size() > best->prefix.size())) {
+			best = &endpoint;
+		}
+	}
+
+	return best;
+}
+
+void CircuitBreaker::Update(Endpoint& endpoint)
+{
+	if (endpoint.state == State::OPEN && Clock::now() - endpoint.opened >= _open_time) {
+		LOG_DEBUG("Circuit for {} half-open, probing.", endpoint.prefix);
+		endpoint.state = State::HALF_OPEN;
+		endpoint.probing = false;
+	}
+}
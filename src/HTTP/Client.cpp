@@ -2,312 +2,1425 @@
 #include <Logger.h>
 #include <Utils.h>
 
-#include <sstream>
 #include <algorithm>
+#include <iterator>
+#include <thread>
 
 HTTPClient::HTTPClient(const std::string& server_host, int server_port) :
-    _unresolved_host(server_host), _port(server_port), _address{}
+    _unresolved_host(server_host), _port(server_port), _resolver(server_host, server_port, RESOLVE_TTL),
+    _prewarm(0), _resolving(false), _keep_alive(false),
+    _transport(Transport::Create(Transport::Kind::SOCKETS)),
+    _pool(*_transport, POOL_MAX_CONNECTIONS, POOL_MAX_IDLE, POOL_IDLE_TIMEOUT, CONNECT_TIMEOUT),
+    _pipeline_depth(PIPELINE_DEPTH), _coalescing(false), _lockers(0), _in_flight(0), _driving(false),
+    _engine_stop(false), _session(std::make_shared<const Session>())
 {
     SetupSystemHeaders();
+    _waker.Attach(*_transport);
+
+    // connections to open once the host is resolved (see Prewarm()) don't wait for the next request
+    _resolver.SetOnResolved([this] { _waker.Wake(); });
+}
+
+HTTPClient::~HTTPClient()
+{
+    // the resolver outlives the waker
+    _resolver.SetOnResolved(nullptr);
+
+    // requests still in flight fail with ECode::ABORTED, their futures too
+    StopEngine();
+    Close();
+}
+
+ECode HTTPClient::Get(
+    HTTPResponse& response, const std::string& path, const SMap& query_params,
+    const SMap& user_headers, const SMap& user_cookies, const HTTPDeadline* deadline)
+{
+    return Request(response, "GET", path, query_params, "", "", user_headers, user_cookies, deadline);
+}
+
+ECode HTTPClient::Post(
+    HTTPResponse& response, const std::string& path, const SMap& query_params,
+    const std::string& data, const std::string& content_type,
+    const SMap& user_headers, const SMap& user_cookies, const HTTPDeadline* deadline)
+{
+    return Request(response, "POST", path, query_params, data, content_type, user_headers, user_cookies, deadline);
+}
+
+ECode HTTPClient::Delete(
+    HTTPResponse& response, const std::string& path, const SMap& query_params,
+    const SMap& user_headers, const SMap& user_cookies, const HTTPDeadline* deadline)
+{
+    return Request(response, "DELETE", path, query_params, "", "", user_headers, user_cookies, deadline);
+}
+
+ECode HTTPClient::Request(
+    HTTPResponse& response, const std::string& method, const std::string& path,
+    const SMap& query_params, const std::string& data, const std::string& content_type,
+    const SMap& user_headers, const SMap& user_cookies, const HTTPDeadline* deadline)
+{
+    ECode result = ECode::OK;
+    std::atomic<bool> done{ false };
+    std::list<Pending> request;
+
+    // `data` outlives the request, it's sent from where it is
+    PendingIt it = Start(request, response, false, deadline, [&](ECode err) { result = err; done = true; });
+    BuildRequest(it->tx, method, path, query_params, data, content_type, user_headers, user_cookies);
+    Post(request);
+
+    // a failed poll fails what's on the connections, this one may still be waiting
+    while (!done) {
+        WaitUntil([&] { return done.load(); });
+    }
+
+    return result;
+}
+
+std::future<HTTPClient::Result> HTTPClient::GetAsync(
+    const std::string& path, const SMap& query_params,
+    const SMap& user_headers, const SMap& user_cookies, const HTTPDeadline* deadline)
+{
+    return RequestAsync("GET", path, query_params, "", "", user_headers, user_cookies, deadline);
+}
+
+std::future<HTTPClient::Result> HTTPClient::PostAsync(
+    const std::string& path, const SMap& query_params,
+    const std::string& data, const std::string& content_type,
+    const SMap& user_headers, const SMap& user_cookies, const HTTPDeadline* deadline)
+{
+    return RequestAsync("POST", path, query_params, data, content_type, user_headers, user_cookies, deadline);
+}
+
+std::future<HTTPClient::Result> HTTPClient::DeleteAsync(
+    const std::string& path, const SMap& query_params,
+    const SMap& user_headers, const SMap& user_cookies, const HTTPDeadline* deadline)
+{
+    return RequestAsync("DELETE", path, query_params, "", "", user_headers, user_cookies, deadline);
+}
+
+std::future<HTTPClient::Result> HTTPClient::RequestAsync(
+    const std::string& method, const std::string& path,
+    const SMap& query_params, const std::string& data, const std::string& content_type,
+    const SMap& user_headers, const SMap& user_cookies, const HTTPDeadline* deadline)
+{
+    // the response is filled in place, then moved into the future
+    struct Call {
+        std::promise<Result> promise;
+        Result result;
+    };
+    auto call = std::make_shared<Call>();
+    std::future<Result> future = call->promise.get_future();
+
+    StartEngine();
+    Submit(call->result.response, { method, path, query_params, data, content_type, user_headers, user_cookies, deadline },
+        [call](ECode err) {
+            call->result.err = err;
+            call->promise.set_value(std::move(call->result));
+        });
+
+    return future;
+}
+
+HTTPClient::Awaitable HTTPClient::GetAwait(
+    const std::string& path, const SMap& query_params,
+    const SMap& user_headers, const SMap& user_cookies, const HTTPDeadline* deadline)
+{
+    return RequestAwait("GET", path, query_params, "", "", user_headers, user_cookies, deadline);
+}
+
+HTTPClient::Awaitable HTTPClient::PostAwait(
+    const std::string& path, const SMap& query_params,
+    const std::string& data, const std::string& content_type,
+    const SMap& user_headers, const SMap& user_cookies, const HTTPDeadline* deadline)
+{
+    return RequestAwait("POST", path, query_params, data, content_type, user_headers, user_cookies, deadline);
+}
+
+HTTPClient::Awaitable HTTPClient::DeleteAwait(
+    const std::string& path, const SMap& query_params,
+    const SMap& user_headers, const SMap& user_cookies, const HTTPDeadline* deadline)
+{
+    return RequestAwait("DELETE", path, query_params, "", "", user_headers, user_cookies, deadline);
+}
+
+HTTPClient::Awaitable HTTPClient::RequestAwait(
+    const std::string& method, const std::string& path,
+    const SMap& query_params, const std::string& data, const std::string& content_type,
+    const SMap& user_headers, const SMap& user_cookies, const HTTPDeadline* deadline)
+{
+    return Awaitable(*this, { method, path, query_params, data, content_type, user_headers, user_cookies, deadline });
+}
+
+HTTPClient::Awaitable::Awaitable(HTTPClient& client, RequestSpec spec) :
+    _client(client), _spec(std::move(spec))
+{
+}
+
+void HTTPClient::Awaitable::await_suspend(std::coroutine_handle<> handle)
+{
+    ResumeQueue* queue = ResumeQueue::Current();
+
+    // nothing is touched after Submit(): the coroutine may already be running on the I/O thread
+    _client.StartEngine();
+    _client.Submit(_result.response, _spec, [this, handle, queue](ECode err) {
+        _result.err = err;
+        if (queue) {
+            queue->Post(handle);
+        } else {
+            handle.resume();
+        }
+    });
 }
 
-SOCKET HTTPClient::Connect()
+ECode HTTPClient::Pipeline(std::vector<HTTPResponse>& responses, const std::vector<RequestSpec>& requests)
 {
-    SOCKET sockfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (sockfd == INVALID_SOCKET) {
-        LOG_ERROR("Socket creation failed, sockerr: {}", SYS_SOCKET_ERROR);
-        return INVALID_SOCKET;
+    ECode result = ECode::OK;
+    std::atomic<size_t> remaining{ requests.size() };
+
+    responses.clear();
+    responses.resize(requests.size());
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+        Submit(responses[i], requests[i], [&](ECode err) {
+            if (err != ECode::OK && result == ECode::OK) {
+                result = err;
+            }
+            --remaining;
+        });
     }
 
-    int ret = connect(sockfd, &_address, sizeof(_address));
-    if (ret == SOCKET_ERROR) {
-        LOG_ERROR("Socket connection failed, sockerr: {}", SYS_SOCKET_ERROR);
-        closesocket(sockfd);
-        return INVALID_SOCKET;
+    while (remaining) {
+        WaitUntil([&] { return remaining.load() == 0; });
     }
 
-    return sockfd;
+    return result;
+}
+
+void HTTPClient::Submit(HTTPResponse& response, const RequestSpec& spec, Completion on_done)
+{
+    // never pipeline requests that aren't safe to resend
+    bool pipelinable = _keep_alive && RetryPolicy::IsIdempotent(spec.method);
+
+    std::list<Pending> request;
+    PendingIt it = Start(request, response, pipelinable, spec.deadline, std::move(on_done));
+    HTTPTransaction& tx = it->tx;
+
+    tx.body_storage = spec.data;
+    BuildRequest(tx, spec.method, spec.path, spec.query_params, tx.body_storage,
+        spec.content_type, spec.user_headers, spec.user_cookies);
+    Post(request);
 }
 
-void HTTPClient::Disconnect(SOCKET sockfd)
+ECode HTTPClient::Run()
 {
-    closesocket(sockfd);
+    return WaitUntil([this] { return GetInFlight() == 0; });
 }
 
-ECode HTTPClient::Send(SOCKET sockfd, const std::string& request)
+ECode HTTPClient::WaitUntil(const std::function<bool()>& done)
 {
-    int buf_idx = 0;
-    int remaining_bytes = static_cast<int>(request.size());
-    int sent_bytes;
+    ECode err = ECode::OK;
+    std::unique_lock<std::mutex> lock(_driver_mutex);
+
+    while (!done() && err == ECode::OK) {
+        // woken up when a request finishes or the driver leaves
+        if (_driving) {
+            _driver_cond.wait(lock);
+            continue;
+        }
 
-    while (remaining_bytes) {
-        sent_bytes = send(sockfd, &request[buf_idx], remaining_bytes, 0);
-        if (sent_bytes == SOCKET_ERROR) {
-            LOG_ERROR("Socket send failed, sockerr: {}", SYS_SOCKET_ERROR);
-            return ECode::SOCKET_SEND;
+        _driving = true;
+        lock.unlock();
+
+        while (!done() && err == ECode::OK) {
+            err = RunOnce(-1);
         }
 
-        buf_idx += sent_bytes;
-        remaining_bytes -= sent_bytes;
+        lock.lock();
+        _driving = false;
+        _driver_cond.notify_all();
     }
 
-    return ECode::OK;
+    return err;
 }
 
-ECode HTTPClient::Receive(SOCKET sockfd, HTTPResponse& response)
+void HTTPClient::StartEngine()
 {
-    char buffer[256];
-    int recv_bytes;
+    std::lock_guard<std::mutex> lock(_engine_mutex);
 
-    response.Reset();
+    if (_engine.joinable()) {
+        return;
+    }
+
+    _engine_stop = false;
+    _engine = std::thread(&HTTPClient::Engine, this);
+}
+
+void HTTPClient::StopEngine()
+{
+    std::lock_guard<std::mutex> lock(_engine_mutex);
+
+    if (!_engine.joinable()) {
+        return;
+    }
+
+    // it's either polling or waiting for another thread to stop driving
+    _engine_stop = true;
+    {
+        std::lock_guard<std::mutex> driver_lock(_driver_mutex);
+    }
+    _driver_cond.notify_all();
+    _waker.Wake();
+
+    _engine.join();
+}
+
+bool HTTPClient::IsEngineRunning() const
+{
+    std::lock_guard<std::mutex> lock(_engine_mutex);
+    return _engine.joinable();
+}
 
-    while (1) {
-        recv_bytes = recv(sockfd, buffer, sizeof(buffer) - 1, 0);
-        if (recv_bytes == SOCKET_ERROR) {
-            LOG_ERROR("Socket receive failed, sockerr: {}", SYS_SOCKET_ERROR);
-            return ECode::SOCKET_RECV;
+void HTTPClient::Engine()
+{
+    while (!_engine_stop) {
+        ECode err = WaitUntil([this] { return _engine_stop.load(); });
+        if (err != ECode::OK) {
+            LOG_ERROR("HTTP I/O thread couldn't poll, errcode: {}", err);
         }
-        if (recv_bytes == 0) {
-            break;
+    }
+}
+
+std::unique_lock<std::mutex> HTTPClient::LockLoop()
+{
+    ++_lockers;
+    _waker.Wake();
+    std::unique_lock<std::mutex> lock(_loop_mutex);
+    --_lockers;
+
+    return lock;
+}
+
+ECode HTTPClient::RunOnce(int timeout_ms)
+{
+    ECode err = ECode::OK;
+
+    // whoever is waiting in LockLoop() goes first, the driver would take the lock right back
+    while (_lockers.load()) {
+        std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(_loop_mutex);
+
+    Admit();
+    if (_prewarm) {
+        UpdateAddress();
+    }
+
+    auto next_retry = ReleaseBackoff();
+    _pool.Evict();
+    DispatchWaiting();
+    auto next_hedge = LaunchHedges();
+
+    // requests that already failed (eg: the host couldn't be resolved) don't wait for the network,
+    // pending connects and requests with limits don't wait past their next deadline
+    if (!_completed.empty()) {
+        timeout_ms = 0;
+    }
+    auto next_timer = std::min({ _pool.GetNextTimer(), CheckDeadlines(), next_retry, next_hedge });
+    if (next_timer != ConnectionPool::Clock::time_point::max()) {
+        auto until = std::chrono::duration_cast<std::chrono::milliseconds>(next_timer - ConnectionPool::Clock::now());
+        int timer_ms = static_cast<int>(std::max<int64_t>(until.count() + 1, 0));
+
+        if (timeout_ms < 0 || timer_ms < timeout_ms) {
+            timeout_ms = timer_ms;
         }
+    }
 
-        buffer[recv_bytes] = 0;
-        response._raw.append(buffer);
+    if (_transport->Poll(timeout_ms) < 0) {
+        // nothing in flight can make progress anymore
+        _pool.Clear();
+        err = ECode::ABORTED;
     }
 
-    return ParseResponse(response);
+    _pool.CheckTimers();
+    _pool.Evict();
+    DispatchWaiting();
+    CheckDeadlines();
+    Finished finished = FinishCompleted();
+
+    // what runs in `on_done` (eg: a resumed coroutine) may call back into the client
+    lock.unlock();
+    Notify(finished);
+
+    return err;
 }
 
-ECode HTTPClient::Get(
-    HTTPResponse& response, const std::string& path, const SMap& query_params,
-    const SMap& user_headers, const SMap& user_cookies)
+size_t HTTPClient::GetInFlight() const
 {
-    return Request(response, "GET", path, query_params, "", "", user_headers, user_cookies);
+    return _in_flight.load();
 }
 
-ECode HTTPClient::Post(
-    HTTPResponse& response, const std::string& path, const SMap& query_params,
-    const std::string& data, const std::string& content_type,
-    const SMap& user_headers, const SMap& user_cookies)
+HTTPClient::PendingIt HTTPClient::Start(
+    std::list<Pending>& requests, HTTPResponse& response, bool pipelinable, const HTTPDeadline* deadline, Completion on_done)
+{
+    PendingIt it = requests.emplace(requests.end());
+    HTTPTransaction& tx = it->tx;
+
+    tx.response = &response;
+    tx.pipelinable = pipelinable;
+    tx.deadline = deadline ? *deadline : GetSession()->deadline;
+    tx.started = tx.phase_started = HTTPDeadline::Clock::now();
+    if (tx.deadline.cancel) {
+        ++tx.deadline.cancel->_users;
+    }
+    tx.on_complete = [this, it](HTTPTransaction&) { OnComplete(it); };
+    it->on_done = std::move(on_done);
+
+    response.Reset();
+    return it;
+}
+
+void HTTPClient::Post(std::list<Pending>& requests)
 {
-    return Request(response, "POST", path, query_params, data, content_type, user_headers, user_cookies);
+    {
+        std::lock_guard<std::mutex> lock(_inbox_mutex);
+
+        _in_flight += requests.size();
+        _inbox.splice(_inbox.end(), requests);
+    }
+
+    // the driver may be waiting in Poll() for something else
+    _waker.Wake();
 }
 
-ECode HTTPClient::Delete(
-    HTTPResponse& response, const std::string& path, const SMap& query_params,
-    const SMap& user_headers, const SMap& user_cookies)
+void HTTPClient::Admit()
 {
-    return Request(response, "DELETE", path, query_params, "", "", user_headers, user_cookies);
+    std::list<Pending> admitted;
+
+    {
+        std::lock_guard<std::mutex> lock(_inbox_mutex);
+        admitted.splice(admitted.end(), _inbox);
+    }
+
+    // iterators stay valid when the nodes are moved from one list to the other
+    while (!admitted.empty()) {
+        PendingIt it = admitted.begin();
+        HTTPTransaction& tx = it->tx;
+
+        _pending.splice(_pending.end(), admitted, it);
+        it->twin = _pending.end();
+
+        // GETs with a cached copy ask only for changes
+        if (!tx.cache_key.empty() && _cache.GetMaxBytes()) {
+            tx.cached = _cache.Find(tx.cache_key);
+            if (tx.cached) {
+                ResponseCache::AddValidators(*tx.cached, tx.headers);
+            }
+        }
+        else {
+            tx.cache_key.clear();
+        }
+
+        _waiting.push_back(it);
+        Coalesce(it);
+    }
 }
 
-ECode HTTPClient::Request(
-    HTTPResponse& response, const std::string& method, const std::string& path,
-    const SMap& query_params, const std::string& data, const std::string& content_type,
-    const SMap& user_headers, const SMap& user_cookies)
+void HTTPClient::Coalesce(PendingIt it)
 {
-    ECode err;
-    SOCKET sockfd;
-    std::string request;
-    SMap merged_headers = user_headers;
-    SMap merged_cookies = user_cookies;
+    HTTPTransaction& tx = it->tx;
 
-    merged_headers.insert(_system_headers.begin(), _system_headers.end());
-    merged_cookies.insert(_system_cookies.begin(), _system_cookies.end());
-    request = std::move(FormatRequest(method, path, query_params, data, content_type, merged_headers, merged_cookies));
-    LOG_DEBUG("Generated HTTP request:\n{}", request);
+    if (tx.flight_key.empty()) {
+        return;
+    }
 
-    sockfd = Connect();
-    if (sockfd == INVALID_SOCKET) {
-        LOG_ERROR("Couldn't connect to HTTP server.");
-        return ECode::SOCKET_CONNECT;
+    auto flight = _flights.find(tx.flight_key);
+    if (flight == _flights.end()) {
+        _flights.emplace(tx.flight_key, it);
+        return;
     }
 
-    err = Send(sockfd, request);
-    if (err != ECode::OK) {
-        LOG_ERROR("Couldn't send HTTP request, errcode: {}", err);
-        Disconnect(sockfd);
-        return err;
+    LOG_DEBUG("Same request already in flight, waiting for its answer.");
+
+    // Admit() queued it last
+    _waiting.pop_back();
+    tx.state = HTTPTransaction::State::FOLLOWING;
+    it->leader = flight->second;
+    flight->second->followers.push_back(it);
+}
+
+void HTTPClient::Land(PendingIt it)
+{
+    HTTPTransaction& tx = it->tx;
+
+    auto flight = _flights.find(tx.flight_key);
+    if (flight != _flights.end() && flight->second == it) {
+        _flights.erase(flight);
     }
 
-    err = Receive(sockfd, response);
-    if (err != ECode::OK) {
-        LOG_ERROR("Couldn't receive HTTP response, errcode: {}", err);
-        Disconnect(sockfd);
-        return err;
+    if (it->followers.empty()) {
+        return;
     }
-    LOG_DEBUG("Raw HTTP response:\n{}", response.GetRaw());
 
-    // update cookies
-    for (const auto kv : response.GetCookies()) {
-        _system_cookies[kv.first] = kv.second;
+    // it ran out of its own time / was cancelled, the others' limits may be different: the first one goes instead
+    if (tx.result == ECode::TIMED_OUT || tx.result == ECode::CANCELLED) {
+        PendingIt next = it->followers.front();
+
+        next->followers.assign(it->followers.begin() + 1, it->followers.end());
+        for (auto follower : next->followers) {
+            follower->leader = next;
+        }
+        it->followers.clear();
+
+        next->tx.state = HTTPTransaction::State::WAITING;
+        _waiting.push_back(next);
+        _flights.emplace(tx.flight_key, next);
+        return;
+    }
+
+    for (auto follower : it->followers) {
+        *follower->tx.response = *tx.response;
+        follower->tx.result = tx.result;
+        follower->tx.state = HTTPTransaction::State::DONE;
+        _completed.push_back(follower);
+    }
+    it->followers.clear();
+}
+
+ECode HTTPClient::UpdateAddress()
+{
+    Resolver::AddressList addresses;
+
+    if (!_resolver.TryGetAddresses(addresses)) {
+        return ECode::HOST_NORESULT;
+    }
+
+    // if the server moved, idle connections to the old addresses are closed
+    _pool.SetAddresses(addresses);
+
+    if (_prewarm) {
+        _pool.Prewarm(_prewarm);
+        _prewarm = 0;
     }
 
-    Disconnect(sockfd);
     return ECode::OK;
 }
 
-void HTTPClient::ClearCookies()
+void HTTPClient::DispatchWaiting()
 {
-    _system_cookies.clear();
+    ECode err;
+    HTTPConnection* conn;
+
+    if (_waiting.empty()) {
+        _resolving = false;
+        return;
+    }
+
+    // the loop never waits for the name, the lookup wakes it up once it's done
+    if (UpdateAddress() != ECode::OK) {
+        if (!_resolving) {
+            _resolving = true;
+            _resolver.Refresh();
+            return;
+        }
+        if (_resolver.IsResolving()) {
+            return;
+        }
+
+        _resolving = false;
+        err = _resolver.GetError();
+        if (err == ECode::OK) {
+            err = ECode::HOST_NORESULT;
+        }
+        LOG_ERROR("Couldn't resolve host, errcode: {}", err);
+
+        while (!_waiting.empty()) {
+            PendingIt it = _waiting.front();
+            _waiting.pop_front();
+
+            it->tx.result = err;
+            it->tx.state = HTTPTransaction::State::DONE;
+            Complete(it);
+        }
+        return;
+    }
+    _resolving = false;
+
+    while (!_waiting.empty()) {
+        HTTPTransaction& tx = _waiting.front()->tx;
+
+        if (!_breaker.Allow(tx.path)) {
+            LOG_DEBUG("Circuit for {} is open, failing fast.", tx.path);
+            PendingIt it = _waiting.front();
+            _waiting.pop_front();
+
+            tx.result = ECode::CIRCUIT_OPEN;
+            tx.state = HTTPTransaction::State::DONE;
+            tx.retryable = false;
+            Complete(it);
+            continue;
+        }
+
+        err = _pool.Acquire(conn, tx.pipelinable, _pipeline_depth);
+        if (err != ECode::OK) {
+            LOG_ERROR("Couldn't connect to HTTP server.");
+            PendingIt it = _waiting.front();
+            _waiting.pop_front();
+
+            tx.result = err;
+            tx.state = HTTPTransaction::State::DONE;
+            tx.retryable = false;
+            OnComplete(it);
+            continue;
+        }
+
+        // every connection is busy, wait for one to free up
+        if (!conn) {
+            break;
+        }
+
+        PendingIt it = _waiting.front();
+        _waiting.pop_front();
+
+        ++tx.attempts;
+        _breaker.OnAttempt(tx.path);
+        conn->Enqueue(tx);
+
+        HedgePolicy::Clock::duration delay;
+        if (tx.attempts == 1 && tx.retries == 0 && _hedge_policy.ShouldHedge(tx.method, tx.path) && _hedge_policy.GetDelay(delay)) {
+            it->hedge_scheduled = true;
+            _hedges.emplace(tx.started + delay, it);
+        }
+    }
 }
 
-std::string HTTPClient::FormatRequest(
-    const std::string& method, const std::string& path, const SMap& query_params, const std::string& data,
-    const std::string& content_type, const SMap& headers, const SMap& cookies)
+HTTPDeadline::Clock::time_point HTTPClient::CheckDeadlines()
 {
-    std::string request;
-    std::string query_string;
+    using Clock = HTTPDeadline::Clock;
 
-    if (query_params.size()) {
-        query_string = "?";
+    auto now = Clock::now();
+    auto next = Clock::time_point::max();
 
-        for (const auto& kv : query_params) {
-            query_string += fmt::format("{}={}&", kv.first, kv.second);
+    for (auto it = _pending.begin(); it != _pending.end(); ++it) {
+        HTTPTransaction& tx = it->tx;
+        const HTTPDeadline& deadline = tx.deadline;
+
+        if (tx.state == HTTPTransaction::State::DONE) {
+            continue;
+        }
+
+        // phases are noticed here, so they start at most one poll late
+        auto phase = HTTPTransaction::Phase::CONNECT;
+        if (tx.state == HTTPTransaction::State::RECEIVING) {
+            phase = HTTPTransaction::Phase::RECV;
+        }
+        else if (tx.state == HTTPTransaction::State::SENDING && tx.connection->GetState() == HTTPConnection::State::OPEN) {
+            phase = HTTPTransaction::Phase::SEND;
+        }
+        if (phase != tx.phase) {
+            tx.phase = phase;
+            tx.phase_started = now;
+        }
+
+        // a follower is bounded by its total limit only, the request it waits for has its own phases
+        Clock::duration limit = deadline.connect;
+        if (tx.state == HTTPTransaction::State::FOLLOWING) {
+            limit = Clock::duration::zero();
+        }
+        else if (phase == HTTPTransaction::Phase::SEND) {
+            limit = deadline.send;
+        }
+        else if (phase == HTTPTransaction::Phase::RECV) {
+            limit = deadline.recv;
+        }
+
+        ECode err = ECode::OK;
+        if (deadline.cancel && deadline.cancel->IsCancelled()) {
+            LOG_DEBUG("HTTP request cancelled.");
+            err = ECode::CANCELLED;
+        }
+        else if ((deadline.total != Clock::duration::zero() && now - tx.started >= deadline.total) ||
+            (limit != Clock::duration::zero() && now - tx.phase_started >= limit)) {
+            LOG_DEBUG("HTTP request timed out.");
+            err = ECode::TIMED_OUT;
+        }
+
+        if (err == ECode::OK) {
+            if (deadline.total != Clock::duration::zero()) {
+                next = std::min(next, tx.started + deadline.total);
+            }
+            if (limit != Clock::duration::zero()) {
+                next = std::min(next, tx.phase_started + limit);
+            }
+            if (deadline.cancel) {
+                next = std::min(next, now + CANCEL_CHECK_INTERVAL);
+            }
+            continue;
         }
+
+        if (tx.state == HTTPTransaction::State::SENDING || tx.state == HTTPTransaction::State::RECEIVING) {
+            tx.connection->Cancel(tx, err);
+            continue;
+        }
+
+        if (tx.state == HTTPTransaction::State::BACKOFF) {
+            auto backoff = std::find_if(_backoff.begin(), _backoff.end(), [&](const auto& kv) { return kv.second == it; });
+            _backoff.erase(backoff);
+        }
+        else if (tx.state == HTTPTransaction::State::FOLLOWING) {
+            auto& followers = it->leader->followers;
+            followers.erase(std::find(followers.begin(), followers.end(), it));
+        }
+        else {
+            _waiting.erase(std::find(_waiting.begin(), _waiting.end(), it));
+        }
+        tx.retryable = false;
+        tx.result = err;
+        tx.state = HTTPTransaction::State::DONE;
+        Complete(it);
     }
 
-    // request type + path-query + HTTP version
-    request = fmt::format("{} {}{} {}\r\n", method, path, query_string, HTTP_VERSION);
+    return next;
+}
 
-    // headers
-    for (const auto& kv : headers) {
-        request += fmt::format("{}: {}\r\n", kv.first, kv.second);
+void HTTPClient::OnComplete(PendingIt it)
+{
+    HTTPTransaction& tx = it->tx;
+    RetryPolicy::Clock::duration delay;
+
+    if (it->hedge) {
+        OnHedgeComplete(it);
+        return;
+    }
+    // cancelled, the response is the copy's
+    if (it->superseded) {
+        _completed.push_back(it);
+        return;
     }
 
-    // cookies
-    if (cookies.size()) {
-        request += "cookie: ";
-        for (const auto& kv : cookies) {
-            request += fmt::format("{}={};", kv.first, kv.second);
+    if (tx.result != ECode::OK) {
+        // the server may drop an idle connection just as we reuse it; the connection only marks
+        // the requests it's safe to send again (idempotent, or not written at all) as retryable
+        if (tx.retryable && tx.attempts < MAX_ATTEMPTS) {
+            // not the server's fault, doesn't count for the circuit
+            _breaker.OnResult(tx.path, ECode::ABORTED, nullptr);
+            LOG_DEBUG("Connection dropped before the response, retrying on another connection.");
+            tx.state = HTTPTransaction::State::WAITING;
+            tx.connection = nullptr;
+            tx.response->Reset();
+            _waiting.push_back(it);
+            return;
+        }
+
+        _breaker.OnResult(tx.path, tx.result, nullptr);
+
+        // the copy may still make it; if it doesn't, this error is the result
+        if (it->twin != _pending.end() && tx.result != ECode::TIMED_OUT && tx.result != ECode::CANCELLED) {
+            LOG_DEBUG("HTTP request failed, waiting for its hedged copy.");
+            return;
+        }
+
+        if (_retry_policy.ShouldRetry(tx.method, tx.retries, tx.result, nullptr, delay) && Retry(it, delay)) {
+            LOG_DEBUG("HTTP request failed, retrying.");
+            return;
         }
-        request += "\r\n";
+
+        LOG_ERROR("HTTP request failed, errcode: {}", tx.result);
+        Complete(it);
+        return;
     }
 
-    // data headers
-    if (data.size()) {
-        request += fmt::format("content-length: {}\r\n", data.length());
-        request += fmt::format("content-type: {}\r\n", content_type);
+    if (tx.attempts == 1 && tx.retries == 0 && _hedge_policy.ShouldHedge(tx.method, tx.path)) {
+        _hedge_policy.AddSample(HTTPDeadline::Clock::now() - tx.started);
     }
 
-    request += "\r\n";
+    _breaker.OnResult(tx.path, tx.result, tx.response);
+    if (!ProcessResponse(*tx.response)) {
+        tx.connection->Shutdown();
+    }
+    UpdateCache(tx);
 
-    // data
-    if (data.size()) {
-        request += data;
+    if (_retry_policy.ShouldRetry(tx.method, tx.retries, tx.result, tx.response, delay) && Retry(it, delay)) {
+        LOG_DEBUG("HTTP server answered {}, retrying.", tx.response->GetCode());
+        return;
     }
 
-    return request;
+    Complete(it);
 }
 
-// ugly af
-ECode HTTPClient::ParseResponse(HTTPResponse& response)
+void HTTPClient::Complete(PendingIt it)
 {
-    enum {
-        STATUS,
-        HEADERS,
-        BODY
-    };
+    PendingIt copy = it->twin;
 
-    auto lines = Utils::Split(response._raw, "\r\n");
-    int state = STATUS;
-    size_t content_length = 0;
-
-    for (const auto& line : lines) {
-        switch (state) {
-            case STATUS: {
-                std::stringstream ss(line);
-                ss >> response._protover >> response._code;   
-                try {
-                    response._status = ss.str().substr(1 + ss.tellg());
-                }
-                catch (const std::out_of_range&) {}
+    _completed.push_back(it);
+
+    if (copy == _pending.end()) {
+        return;
+    }
+
+    // the copy lost, its connection is closed so the server stops working on it
+    it->twin = _pending.end();
+    copy->twin = _pending.end();
+    if (copy->tx.state != HTTPTransaction::State::DONE) {
+        copy->tx.connection->Cancel(copy->tx, ECode::CANCELLED);
+    }
+}
+
+HTTPDeadline::Clock::time_point HTTPClient::LaunchHedges()
+{
+    auto now = HTTPDeadline::Clock::now();
+
+    while (!_hedges.empty() && _hedges.begin()->first <= now) {
+        PendingIt it = _hedges.begin()->second;
+        _hedges.erase(_hedges.begin());
+        it->hedge_scheduled = false;
+
+        // answered, failed or being retried in the meantime
+        if (it->tx.state == HTTPTransaction::State::SENDING || it->tx.state == HTTPTransaction::State::RECEIVING) {
+            Hedge(it);
+        }
+    }
+
+    return _hedges.empty() ? HTTPDeadline::Clock::time_point::max() : _hedges.begin()->first;
+}
+
+void HTTPClient::Hedge(PendingIt it)
+{
+    HTTPTransaction& tx = it->tx;
+    HTTPConnection* conn;
+
+    // the copy's result counts for the endpoint like any other attempt's
+    if (!_breaker.Allow(tx.path)) {
+        LOG_DEBUG("Circuit for {} is open, not hedging.", tx.path);
+        return;
+    }
+
+    // an idle or a new connection only: pipelined behind the slow one, the copy would be just as slow
+    if (_pool.Acquire(conn, false, _pipeline_depth) != ECode::OK || !conn) {
+        LOG_DEBUG("No connection to send the hedged request on.");
+        return;
+    }
+
+    PendingIt copy_it = _pending.emplace(_pending.end());
+    HTTPTransaction& copy = copy_it->tx;
+    ++_in_flight;
+
+    copy_it->hedge = true;
+    copy_it->twin = it;
+    copy_it->hedge_response = std::make_unique<HTTPResponse>();
+    it->twin = copy_it;
+
+    copy.method = tx.method;
+    copy.path = tx.path;
+    copy.request_line = tx.request_line;
+    copy.static_headers = tx.static_headers;
+    copy.cookie_header = tx.cookie_header;
+    copy.headers = tx.headers;
+    copy.cache_key = tx.cache_key;
+    copy.cached = tx.cached;
+    copy.body = tx.body;            // the copy never outlives the original's body
+    copy.response = copy_it->hedge_response.get();
+    copy.deadline = tx.deadline;
+    copy.started = tx.started;
+    copy.phase_started = HTTPDeadline::Clock::now();
+    if (copy.deadline.cancel) {
+        ++copy.deadline.cancel->_users;
+    }
+    copy.on_complete = [this, copy_it](HTTPTransaction&) { OnComplete(copy_it); };
+
+    LOG_DEBUG("HTTP request is slow, sending a hedged copy.");
+    ++copy.attempts;
+    _breaker.OnAttempt(copy.path);
+    conn->Enqueue(copy);
+}
+
+void HTTPClient::OnHedgeComplete(PendingIt it)
+{
+    HTTPTransaction& copy = it->tx;
+    PendingIt original = it->twin;
+
+    // dropped either way, the original is the one reported
+    _completed.push_back(it);
+
+    // lost the race
+    if (original == _pending.end()) {
+        return;
+    }
+
+    HTTPTransaction& tx = original->tx;
+    it->twin = _pending.end();
+    original->twin = _pending.end();
+
+    if (copy.result != ECode::OK) {
+        // the original failed already, it's done now
+        if (tx.state == HTTPTransaction::State::DONE) {
+            LOG_ERROR("HTTP request failed, errcode: {}", tx.result);
+            _completed.push_back(original);
+        }
+        return;
+    }
+
+    LOG_DEBUG("Hedged HTTP request answered first.");
+    _breaker.OnResult(tx.path, copy.result, copy.response);
+    if (!ProcessResponse(*copy.response)) {
+        copy.connection->Shutdown();
+    }
+    UpdateCache(copy);
+
+    // the original is still slower than this, it counts as a sample too
+    _hedge_policy.AddSample(HTTPDeadline::Clock::now() - tx.started);
+
+    original->superseded = true;
+    if (tx.state == HTTPTransaction::State::SENDING || tx.state == HTTPTransaction::State::RECEIVING) {
+        tx.connection->Cancel(tx, ECode::CANCELLED);
+    }
+    else {
+        if (tx.state == HTTPTransaction::State::BACKOFF) {
+            auto backoff = std::find_if(_backoff.begin(), _backoff.end(), [&](const auto& kv) { return kv.second == original; });
+            _backoff.erase(backoff);
+        }
+        else if (tx.state == HTTPTransaction::State::WAITING) {
+            _waiting.erase(std::find(_waiting.begin(), _waiting.end(), original));
+        }
+        tx.state = HTTPTransaction::State::DONE;
+        _completed.push_back(original);
+    }
+
+    *tx.response = std::move(*copy.response);
+    tx.result = ECode::OK;
+}
+
+bool HTTPClient::Retry(PendingIt it, RetryPolicy::Clock::duration delay)
+{
+    HTTPTransaction& tx = it->tx;
+    auto when = HTTPDeadline::Clock::now() + delay;
+
+    // no point in waiting past the request's deadline, the last answer / error is better than a timeout
+    if (tx.deadline.total != HTTPDeadline::Clock::duration::zero() && when >= tx.started + tx.deadline.total) {
+        return false;
+    }
+
+    ++tx.retries;
+    tx.state = HTTPTransaction::State::BACKOFF;
+    tx.retryable = false;
+    tx.connection = nullptr;
+    tx.result = ECode::OK;
+    tx.response->Reset();
+
+    _backoff.emplace(when, it);
+    return true;
+}
+
+HTTPDeadline::Clock::time_point HTTPClient::ReleaseBackoff()
+{
+    auto now = HTTPDeadline::Clock::now();
+
+    while (!_backoff.empty() && _backoff.begin()->first <= now) {
+        PendingIt it = _backoff.begin()->second;
+        _backoff.erase(_backoff.begin());
+
+        it->tx.state = HTTPTransaction::State::WAITING;
+        _waiting.push_back(it);
+    }
+
+    return _backoff.empty() ? HTTPDeadline::Clock::time_point::max() : _backoff.begin()->first;
+}
+
+HTTPClient::Finished HTTPClient::FinishCompleted()
+{
+    Finished finished;
+
+    while (!_completed.empty()) {
+        PendingIt it = _completed.front();
+        _completed.pop_front();
+
+        if (!it->tx.flight_key.empty()) {
+            Land(it);
+        }
+        if (it->hedge_scheduled) {
+            auto hedge = std::find_if(_hedges.begin(), _hedges.end(), [&](const auto& kv) { return kv.second == it; });
+            _hedges.erase(hedge);
+        }
+
+        finished.emplace_back(std::move(it->on_done), it->tx.result);
+        if (it->tx.deadline.cancel) {
+            --it->tx.deadline.cancel->_users;
+        }
+        _pending.erase(it);
+        --_in_flight;
+    }
+
+    return finished;
+}
+
+void HTTPClient::Notify(Finished& finished)
+{
+    // nothing finished, nobody to wake up
+    if (finished.empty()) {
+        return;
+    }
+
+    for (auto& [on_done, result] : finished) {
+        if (on_done) {
+            on_done(result);
+        }
+    }
+
+    // the threads waiting in WaitUntil() check if theirs are done; taking the mutex first
+    // makes sure none of them is between checking and waiting
+    {
+        std::lock_guard<std::mutex> lock(_driver_mutex);
+    }
+    _driver_cond.notify_all();
+}
+
+void HTTPClient::BuildRequest(
+    HTTPTransaction& tx, const std::string& method, const std::string& path, const SMap& query_params,
+    std::string_view data, const std::string& content_type, const SMap& user_headers, const SMap& user_cookies)
+{
+    const SMap* headers = &user_headers;
+    const SMap* cookies = &user_cookies;
+    SMap merged_headers;
+    SMap merged_cookies;
+    bool overridden = false;
+
+    // the session may change meanwhile (eg: a response sets a cookie), this request goes out as it is now
+    auto session = GetSession();
+
+    tx.method = method;
+    tx.path = path;
+
+    // usually the system headers and cookies go out as they were last serialized;
+    // user headers / cookies win over them, so then they're merged and formatted here
+    for (const auto& kv : user_headers) {
+        for (const auto& system : session->headers) {
+            overridden = overridden || Utils::EqualsNoCase(kv.first, system.first);
+        }
+    }
+
+    tx.static_headers = session->static_headers;
+    if (overridden) {
+        merged_headers = user_headers;
+        merged_headers.insert(session->headers.begin(), session->headers.end());
+        headers = &merged_headers;
+        tx.static_headers = nullptr;
+    }
+
+    tx.cookie_header = nullptr;
+    if (user_cookies.empty()) {
+        tx.cookie_header = session->cookie_header;
+    }
+    else {
+        merged_cookies = user_cookies;
+        merged_cookies.insert(session->cookies.begin(), session->cookies.end());
+        cookies = &merged_cookies;
+    }
 
-                state = HEADERS;
-                break;
+    FormatRequest(tx, method, path, query_params, data, content_type, *headers, *cookies);
+
+    // the caller revalidates on its own, the 304 is for it
+    bool conditional = std::any_of(user_headers.begin(), user_headers.end(), [](const auto& kv) {
+        return Utils::EqualsNoCase(kv.first, "if-none-match") || Utils::EqualsNoCase(kv.first, "if-modified-since");
+    });
+
+    // the answer depends on who asks, so the authorization is part of both keys
+    std::string_view authorization;
+    const SMap* maps[] = { &user_headers, &session->headers };
+    for (const SMap* map : maps) {
+        for (const auto& kv : *map) {
+            if (authorization.empty() && Utils::EqualsNoCase(kv.first, "authorization")) {
+                authorization = kv.second;
             }
-            case HEADERS: {
-                if (line.length() == 0) {
-                    state = BODY;
-                }
-                else {
-                    auto pos = line.find(':');
-                    if (pos != std::string::npos) {
-                        std::string key = Utils::ToLower(line.substr(0, pos));
-                        std::string val = line.substr(pos + 2);
-
-                        if (key != "set-cookie") {
-                            response._headers[key] = val;
-
-                            if (key == "content-length") {
-                                content_length = std::atoi(val.c_str());
-                            }
-                        }
-                        else {
-                            pos = val.find("=");
-
-                            if (pos != std::string::npos) {
-                                std::string cookie_key = val.substr(0, pos);
-                                std::string cookie_val = val.substr(pos + 1);
-
-                                pos = cookie_val.find(';');
-                                if (pos != std::string::npos) {
-                                    cookie_val.erase(pos);
-                                }
-
-                                response._cookies[cookie_key] = cookie_val;
-                            }
-                        }
-                    }
+        }
+    }
+
+    // looked up once admitted, the cache belongs to the driving thread
+    tx.cache_key.clear();
+    tx.cached = nullptr;
+    if (method == "GET" && !conditional) {
+        tx.cache_key = tx.request_line.substr(0, tx.request_line.rfind(' '));
+        tx.cache_key += '\n';
+        tx.cache_key += authorization;
+    }
+
+    tx.flight_key.clear();
+    if (method == "GET" && _coalescing && !conditional) {
+        tx.flight_key = tx.cache_key;
+    }
+
+    tx.body = data;
+    LOG_DEBUG("Generated HTTP request:\n{}{}{}{}{}", tx.request_line, tx.static_headers ? *tx.static_headers : "",
+        tx.cookie_header ? *tx.cookie_header : "", tx.headers, tx.body);
+}
+
+std::shared_ptr<const HTTPClient::Session> HTTPClient::GetSession() const
+{
+    return _session.load();
+}
+
+void HTTPClient::UpdateSession(const std::function<bool(Session&)>& update)
+{
+    std::shared_ptr<const Session> current = _session.load();
+
+    while (true) {
+        auto next = std::make_shared<Session>(*current);
+        if (!update(*next)) {
+            return;
+        }
+
+        // another thread published first: `current` is now its session, the change is made again on it
+        if (_session.compare_exchange_weak(current, std::shared_ptr<const Session>(std::move(next)))) {
+            return;
+        }
+    }
+}
+
+bool HTTPClient::ProcessResponse(const HTTPResponse& response)
+{
+    LOG_DEBUG("Raw HTTP response:\n{}", response.GetRaw());
+
+    // update cookies, the cookie header is serialized once per change
+    if (response.GetCookieCount()) {
+        UpdateSession([&](Session& session) {
+            bool changed = false;
+
+            for (size_t i = 0; i < response.GetCookieCount(); ++i) {
+                auto cookie = response.GetCookieAt(i);
+                auto it = session.cookies.find(std::string(cookie.name));
+
+                if (it == session.cookies.end() || it->second != cookie.value) {
+                    session.cookies[std::string(cookie.name)] = std::string(cookie.value);
+                    changed = true;
                 }
-                break;
             }
-            case BODY: {
-                response._data += line;
-                if (response._data.length() < content_length) {
-                    response._data += "\r\n";
-                }
-                break;
+            if (!changed) {
+                return false;
+            }
+
+            std::string block = "cookie: ";
+            for (const auto& kv : session.cookies) {
+                fmt::format_to(std::back_inserter(block), "{}={};", kv.first, kv.second);
             }
+            block += "\r\n";
+            session.cookie_header = std::make_shared<const std::string>(std::move(block));
+            return true;
+        });
+    }
+
+    auto connection = response.GetHeader("connection");
+    bool server_closes = connection && Utils::EqualsNoCase(*connection, "close");
+    return _keep_alive && !server_closes;
+}
+
+void HTTPClient::UpdateCache(HTTPTransaction& tx)
+{
+    if (tx.cache_key.empty()) {
+        return;
+    }
+
+    int code = tx.response->GetCode();
+    if (code == 304 && tx.cached) {
+        LOG_DEBUG("{} not modified, answered from the cache.", tx.path);
+        *tx.response = *tx.cached;
+    }
+    else if (code == 200) {
+        _cache.Store(tx.cache_key, *tx.response);
+    }
+    else if (code < 500) {
+        // eg: 404 after it was deleted; a server error says nothing about the copy
+        _cache.Remove(tx.cache_key);
+    }
+}
+
+void HTTPClient::ClearCookies()
+{
+    UpdateSession([](Session& session) {
+        if (session.cookies.empty()) {
+            return false;
         }
+
+        session.cookies.clear();
+        session.cookie_header = nullptr;
+        return true;
+    });
+}
+
+void HTTPClient::SetKeepAlive(bool enable)
+{
+    _keep_alive = enable;
+    SetupSystemHeaders();
+
+    if (!_keep_alive) {
+        Close();
     }
-    
-    return ECode::OK;
 }
 
-ECode HTTPClient::ResolveHost()
+bool HTTPClient::GetKeepAlive() const
+{
+    return _keep_alive;
+}
+
+void HTTPClient::Close()
+{
+    auto lock = LockLoop();
+    Finished finished = Abort();
+
+    lock.unlock();
+    Notify(finished);
+}
+
+HTTPClient::Finished HTTPClient::Abort()
 {
-    ECode err = ECode::HOST_NORESULT;
-    int ret;
+    // requests still in flight fail with ECode::ABORTED
+    Admit();
+    _pool.Clear();
+    _prewarm = 0;
 
-    struct addrinfo* result = nullptr;
-    struct addrinfo hints {};
+    while (!_waiting.empty()) {
+        _waiting.front()->tx.result = ECode::ABORTED;
+        _completed.push_back(_waiting.front());
+        _waiting.pop_front();
+    }
+    for (const auto& kv : _backoff) {
+        kv.second->tx.result = ECode::ABORTED;
+        _completed.push_back(kv.second);
+    }
+    _backoff.clear();
+
+    // called from another thread, the driver may be polling again already for the requests failed here
+    _waker.Wake();
+    return FinishCompleted();
+}
 
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
+Transport::Kind HTTPClient::SetTransport(Transport::Kind kind)
+{
+    auto lock = LockLoop();
+    Finished finished;
+
+    if (kind != _transport->GetKind()) {
+        finished = Abort();
 
-    ret = getaddrinfo(_unresolved_host.c_str(), std::to_string(_port).c_str(), &hints, &result);
-    if (ret != 0) {
-        return ECode::HOST_ADDRINFO;
+        _waker.Detach();
+        _transport = Transport::Create(kind);
+        _pool.SetTransport(*_transport);
+        _waker.Attach(*_transport);
     }
+    kind = _transport->GetKind();
 
-    for (struct addrinfo* ptr = result; ptr != nullptr; ptr = ptr->ai_next) {
-        if (ptr->ai_family == AF_INET && ptr->ai_socktype == SOCK_STREAM && ptr->ai_protocol == IPPROTO_TCP) {
+    lock.unlock();
+    Notify(finished);
+    return kind;
+}
 
-            memcpy(&_address, ptr->ai_addr, sizeof(struct sockaddr));
-            err = ECode::OK;
-            break;
+Transport::Kind HTTPClient::GetTransport() const
+{
+    return _transport->GetKind();
+}
+
+void HTTPClient::SetPoolLimits(size_t max_idle, ConnectionPool::Clock::duration idle_timeout)
+{
+    auto lock = LockLoop();
+    _pool.SetLimits(max_idle, idle_timeout);
+}
+
+void HTTPClient::SetRetryPolicy(const RetryPolicy& policy)
+{
+    auto lock = LockLoop();
+    _retry_policy = policy;
+}
+
+RetryPolicy HTTPClient::GetRetryPolicy()
+{
+    auto lock = LockLoop();
+    return _retry_policy;
+}
+
+void HTTPClient::SetCoalescing(bool enable)
+{
+    _coalescing = enable;
+}
+
+void HTTPClient::SetResponseCacheSize(size_t max_bytes)
+{
+    auto lock = LockLoop();
+    _cache.SetMaxBytes(max_bytes);
+}
+
+void HTTPClient::ClearResponseCache()
+{
+    // the driving thread may be storing a response meanwhile
+    auto lock = LockLoop();
+    _cache.Clear();
+}
+
+void HTTPClient::SetCircuitBreaker(const CircuitBreaker& breaker)
+{
+    auto lock = LockLoop();
+    _breaker = breaker;
+}
+
+CircuitBreaker HTTPClient::GetCircuitBreaker()
+{
+    auto lock = LockLoop();
+    return _breaker;
+}
+
+void HTTPClient::SetHedgePolicy(const HedgePolicy& policy)
+{
+    auto lock = LockLoop();
+    _hedge_policy = policy;
+}
+
+HedgePolicy HTTPClient::GetHedgePolicy()
+{
+    auto lock = LockLoop();
+    return _hedge_policy;
+}
+
+void HTTPClient::SetDeadline(const HTTPDeadline& deadline)
+{
+    // read by the threads making requests, not by the loop
+    UpdateSession([&](Session& session) {
+        session.deadline = deadline;
+        return true;
+    });
+}
+
+HTTPDeadline HTTPClient::GetDeadline() const
+{
+    return GetSession()->deadline;
+}
+
+void HTTPClient::SetPipelineDepth(size_t depth)
+{
+    auto lock = LockLoop();
+    _pipeline_depth = std::max<size_t>(depth, 1);
+}
+
+void HTTPClient::SetMaxConnections(size_t max_connections)
+{
+    auto lock = LockLoop();
+    _pool.SetMaxConnections(max_connections);
+}
+
+void HTTPClient::SetConnectTimeout(ConnectionPool::Clock::duration timeout)
+{
+    auto lock = LockLoop();
+    _pool.SetConnectTimeout(timeout);
+}
+
+size_t HTTPClient::Prewarm(size_t count)
+{
+    if (!_keep_alive) {
+        return 0;
+    }
+
+    // not under the loop lock, StopEngine() holds the engine's while waiting for it
+    bool engine = IsEngineRunning();
+
+    {
+        auto lock = LockLoop();
+
+        // the I/O thread (or whoever calls RunOnce() next) opens them once the host is resolved,
+        // a lookup finishing wakes it up; nobody else may drive the transport while it runs
+        if (engine || UpdateAddress() != ECode::OK) {
+            _prewarm = count;
+            return count;
         }
+
+        _pool.Prewarm(count);
     }
 
-    freeaddrinfo(result);
-    return err;
+    while (true) {
+        {
+            auto lock = LockLoop();
+            if (!_pool.GetConnectingCount()) {
+                return _pool.GetIdleCount();
+            }
+        }
+        RunOnce(-1);
+    }
+}
+
+void HTTPClient::FormatRequest(
+    HTTPTransaction& tx, const std::string& method, const std::string& path, const SMap& query_params,
+    std::string_view data, const std::string& content_type, const SMap& headers, const SMap& cookies)
+{
+    std::string query_string;
+
+    if (query_params.size()) {
+        query_string = "?";
+
+        for (const auto& kv : query_params) {
+            fmt::format_to(std::back_inserter(query_string), "{}={}&", kv.first, kv.second);
+        }
+    }
+
+    // request type + path-query + HTTP version
+    tx.request_line = fmt::format("{} {}{} {}\r\n", method, path, query_string, HTTP_VERSION);
+
+    // headers, the system ones are usually in the static block already
+    tx.headers.clear();
+    for (const auto& kv : headers) {
+        fmt::format_to(std::back_inserter(tx.headers), "{}: {}\r\n", kv.first, kv.second);
+    }
+
+    // cookies
+    if (cookies.size()) {
+        tx.headers += "cookie: ";
+        for (const auto& kv : cookies) {
+            fmt::format_to(std::back_inserter(tx.headers), "{}={};", kv.first, kv.second);
+        }
+        tx.headers += "\r\n";
+    }
+
+    // data headers, the data itself is sent from where it is
+    if (data.size()) {
+        fmt::format_to(std::back_inserter(tx.headers), "content-length: {}\r\n", data.length());
+        fmt::format_to(std::back_inserter(tx.headers), "content-type: {}\r\n", content_type);
+    }
+
+    tx.headers += "\r\n";
+}
+
+ECode HTTPClient::ResolveHost()
+{
+    Resolver::AddressList addresses;
+    ECode err;
+
+    err = _resolver.Resolve(addresses);
+    if (err != ECode::OK) {
+        return err;
+    }
+
+    auto lock = LockLoop();
+    _pool.SetAddresses(addresses);
+    return ECode::OK;
+}
+
+void HTTPClient::ResolveHostAsync()
+{
+    _resolver.Refresh();
+}
+
+void HTTPClient::SetResolveTtl(Resolver::Clock::duration ttl)
+{
+    _resolver.SetTtl(ttl);
 }
 
 void HTTPClient::SetupSystemHeaders()
 {
-    _system_headers["host"] = fmt::format("{}:{}", _unresolved_host, _port);
-    _system_headers["connection"] = "close";
+    UpdateSession([this](Session& session) {
+        std::string block;
+
+        session.headers["host"] = fmt::format("{}:{}", _unresolved_host, _port);
+        session.headers["connection"] = _keep_alive ? "keep-alive" : "close";
+
+        // serialized once, requests already queued keep the block they were built with
+        for (const auto& kv : session.headers) {
+            fmt::format_to(std::back_inserter(block), "{}: {}\r\n", kv.first, kv.second);
+        }
+        session.static_headers = std::make_shared<const std::string>(std::move(block));
+        return true;
+    });
 }
 
 ECode HTTPClient::GlobalStartup()
@@ -0,0 +1,544 @@
+#include <HTTP/Connection.h>
+#include <HTTP/RetryPolicy.h>
+#include <Logger.h>
+
+#include <algorithm>
+
+HTTPConnection::HTTPConnection(Transport& transport) :
+	_transport(transport), _sockfd(INVALID_SOCKET), _state(State::CLOSED), _sending(false),
+	_next_address(0), _first_address(0), _address_index(std::string::npos), _served(0), _idle_since(Clock::now())
+{
+}
+
+HTTPConnection::~HTTPConnection()
+{
+	Close();
+}
+
+bool HTTPConnection::Open(const Resolver::AddressList& addresses, size_t first, Clock::duration timeout)
+{
+	if (!addresses || addresses->empty()) {
+		return false;
+	}
+
+	_addresses = addresses;
+	_next_address = 0;
+	_first_address = first < addresses->size() ? first : 0;
+	_connect_deadline = Clock::now() + timeout;
+
+	if (!StartAttempt()) {
+		LOG_ERROR("Socket connection failed.");
+		return false;
+	}
+
+	_state = State::CONNECTING;
+	_idle_since = Clock::now();
+	return true;
+}
+
+bool HTTPConnection::StartAttempt()
+{
+	// addresses that can't even be tried are skipped
+	while (_next_address < _addresses->size()) {
+		size_t index = (_first_address + _next_address++) % _addresses->size();
+		const SysAddress& address = (*_addresses)[index];
+
+		SOCKET sockfd = _transport.Socket(address.GetFamily());
+		if (sockfd == INVALID_SOCKET) {
+			continue;
+		}
+
+		auto attempt = std::make_unique<Attempt>(*this, sockfd, index);
+		if (!_transport.Add(sockfd, attempt.get())) {
+			closesocket(sockfd);
+			continue;
+		}
+		if (!_transport.Connect(sockfd, address)) {
+			_transport.Remove(sockfd);
+			closesocket(sockfd);
+			continue;
+		}
+
+		_attempts.push_back(std::move(attempt));
+		_next_attempt = Clock::now() + ATTEMPT_DELAY;
+		return true;
+	}
+
+	return false;
+}
+
+void HTTPConnection::OnAttemptConnect(Attempt& attempt, int result)
+{
+	if (result < 0) {
+		LOG_DEBUG("Connect attempt failed, sockerr: {}", -result);
+		CloseAttempt(attempt);
+
+		// no point in waiting for the attempt delay, try the next address right away
+		if (!StartAttempt() && _attempts.empty()) {
+			OnConnect(result);
+		}
+		return;
+	}
+
+	// the winner is handed over to the connection, the others are dropped (`attempt` too)
+	SOCKET sockfd = attempt.GetSocket();
+	size_t address_index = attempt.GetAddressIndex();
+
+	_transport.Remove(sockfd);
+	for (const auto& other : _attempts) {
+		if (other.get() != &attempt) {
+			_transport.Remove(other->GetSocket());
+			closesocket(other->GetSocket());
+		}
+	}
+	_attempts.clear();
+
+	_sockfd = sockfd;
+	_address_index = address_index;
+	if (!_transport.Add(_sockfd, this)) {
+		LOG_ERROR("Socket connection failed.");
+		Fail(ECode::SOCKET_CONNECT, false);
+		return;
+	}
+	OnConnect(0);
+}
+
+void HTTPConnection::CloseAttempt(Attempt& attempt)
+{
+	SOCKET sockfd = attempt.GetSocket();
+
+	_transport.Remove(sockfd);
+	closesocket(sockfd);
+
+	_attempts.erase(std::find_if(_attempts.begin(), _attempts.end(), [&](const std::unique_ptr<Attempt>& a) {
+		return a.get() == &attempt;
+	}));
+}
+
+void HTTPConnection::CheckTimers(Clock::time_point now)
+{
+	if (_state != State::CONNECTING) {
+		return;
+	}
+
+	if (now >= _connect_deadline) {
+		LOG_ERROR("Couldn't connect to HTTP server in time.");
+		Fail(ECode::SOCKET_CONNECT, false);
+		return;
+	}
+
+	// the attempts so far are taking too long, race them with the next address
+	if (now >= _next_attempt && _next_address < _addresses->size()) {
+		LOG_DEBUG("Connect attempt is slow, trying the next address.");
+		StartAttempt();
+	}
+}
+
+HTTPConnection::Clock::time_point HTTPConnection::GetNextTimer() const
+{
+	if (_state != State::CONNECTING) {
+		return Clock::time_point::max();
+	}
+	if (_next_address < _addresses->size()) {
+		return std::min(_next_attempt, _connect_deadline);
+	}
+	return _connect_deadline;
+}
+
+void HTTPConnection::Enqueue(HTTPTransaction& tx)
+{
+	tx.connection = this;
+	tx.state = HTTPTransaction::State::SENDING;
+	tx.sent = 0;
+
+	_to_send.push_back(&tx);
+	PostSend();
+}
+
+void HTTPConnection::Shutdown()
+{
+	if (_state == State::CLOSED && GetInFlight() == 0) {
+		return;
+	}
+
+	Fail(ECode::SOCKET_RECV, true);
+}
+
+void HTTPConnection::Abort(ECode err)
+{
+	Fail(err, false);
+}
+
+void HTTPConnection::Cancel(HTTPTransaction& tx, ECode err)
+{
+	auto queued = std::find(_to_send.begin(), _to_send.end(), &tx);
+
+	tx.retryable = false;
+
+	// nothing of it went out yet (or is going out), the connection can go on without it
+	if (queued != _to_send.end() && tx.sent == 0 && !_sending) {
+		_to_send.erase(queued);
+		Complete(tx, err);
+		return;
+	}
+
+	// the server sees a partial request / we'd get a response nobody waits for: the connection
+	// is useless now, but the other requests on it did nothing wrong
+	bool partial = !_to_receive.empty() && _parser.IsStarted();
+	std::deque<HTTPTransaction*> others;
+
+	for (auto* other : _to_receive) {
+		if (other != &tx) {
+			// the first one may be half received already; a POST that went out may have been processed
+			other->retryable = !(partial && other == _to_receive.front()) && RetryPolicy::IsIdempotent(other->method);
+			others.push_back(other);
+		}
+	}
+	for (auto* other : _to_send) {
+		if (other != &tx) {
+			other->retryable = true;
+			others.push_back(other);
+		}
+	}
+	_to_receive.clear();
+	_to_send.clear();
+
+	Close();
+
+	Complete(tx, err);
+	for (auto* other : others) {
+		Complete(*other, ECode::SOCKET_RECV);
+	}
+}
+
+HTTPConnection::State HTTPConnection::GetState() const
+{
+	return _state;
+}
+
+size_t HTTPConnection::GetInFlight() const
+{
+	return _to_send.size() + _to_receive.size();
+}
+
+size_t HTTPConnection::GetServed() const
+{
+	return _served;
+}
+
+size_t HTTPConnection::GetAddressIndex() const
+{
+	return _state == State::OPEN ? _address_index : std::string::npos;
+}
+
+HTTPConnection::Clock::time_point HTTPConnection::GetIdleSince() const
+{
+	return _idle_since;
+}
+
+bool HTTPConnection::IsIdle() const
+{
+	return _state == State::OPEN && GetInFlight() == 0;
+}
+
+bool HTTPConnection::IsAlive()
+{
+	char c;
+
+	if (_state != State::OPEN) {
+		return false;
+	}
+	if (GetInFlight()) {
+		return true;
+	}
+
+	// an idle keep-alive connection has nothing to read, so if it's readable
+	// the server either closed it (EOF / RST) or sent something we never asked for
+	int ret = recv(_sockfd, &c, 1, SYS_PEEK_FLAGS);
+	if (ret == SOCKET_ERROR && SYS_WOULD_BLOCK(SYS_SOCKET_ERROR)) {
+		return true;
+	}
+
+	Close();
+	return false;
+}
+
+bool HTTPConnection::CanPipeline(size_t depth) const
+{
+	if (_state == State::CLOSED || GetInFlight() >= depth) {
+		return false;
+	}
+
+	for (const auto* tx : _to_send) {
+		if (!tx->pipelinable) {
+			return false;
+		}
+	}
+	for (const auto* tx : _to_receive) {
+		if (!tx->pipelinable) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void HTTPConnection::OnConnect(int result)
+{
+	if (result < 0) {
+		LOG_ERROR("Socket connection failed, sockerr: {}", -result);
+		Fail(ECode::SOCKET_CONNECT, false);
+		return;
+	}
+
+	_state = State::OPEN;
+	_idle_since = Clock::now();
+
+	PostRecv();
+	PostSend();
+}
+
+void HTTPConnection::OnSend(int result)
+{
+	_sending = false;
+
+	if (result < 0) {
+		LOG_DEBUG("Socket send failed, sockerr: {}", -result);
+		Fail(ECode::SOCKET_SEND, true);
+		return;
+	}
+
+	// one send may have covered several pipelined requests
+	size_t left = result;
+	while (left && !_to_send.empty()) {
+		HTTPTransaction& tx = *_to_send.front();
+		size_t n = std::min(left, tx.GetSize() - tx.sent);
+
+		tx.sent += n;
+		left -= n;
+		if (tx.sent < tx.GetSize()) {
+			break;
+		}
+
+		tx.state = HTTPTransaction::State::RECEIVING;
+		_to_receive.push_back(&tx);
+		_to_send.pop_front();
+	}
+
+	PostSend();
+}
+
+void HTTPConnection::OnRecv(int result)
+{
+	if (result < 0) {
+		LOG_DEBUG("Socket receive failed, sockerr: {}", -result);
+		Fail(ECode::SOCKET_RECV, true);
+		return;
+	}
+	if (result == 0) {
+		OnClosedByPeer();
+		return;
+	}
+
+	_parser.Commit(result);
+	Receive();
+
+	if (_state == State::OPEN) {
+		PostRecv();
+	}
+}
+
+void HTTPConnection::PostSend()
+{
+	if (_state != State::OPEN || _sending || _to_send.empty()) {
+		return;
+	}
+
+	SysIoVec iov[MAX_SEND_IOVECS];
+	size_t count = 0;
+
+	// everything queued goes out together, without joining the requests first
+	for (const auto* tx : _to_send) {
+		count += tx->GetIoVecs(iov + count, MAX_SEND_IOVECS - count);
+		if (count == MAX_SEND_IOVECS) {
+			break;
+		}
+	}
+
+	_sending = true;
+	if (!_transport.Send(_sockfd, iov, count)) {
+		_sending = false;
+		Fail(ECode::SOCKET_SEND, true);
+	}
+}
+
+void HTTPConnection::PostRecv()
+{
+	size_t len;
+	char* buffer = _parser.GetRecvBuffer(len);
+
+	// a receive is always posted while the connection is open, straight into the parser's buffer
+	if (!_transport.Recv(_sockfd, buffer, len)) {
+		Fail(ECode::SOCKET_RECV, true);
+	}
+}
+
+void HTTPConnection::OnClosedByPeer()
+{
+	// a response without content-length / chunked framing ends when the connection does
+	if (!_to_receive.empty() && _parser.GetResponse() && _parser.FinishEof()) {
+		HTTPTransaction& tx = *_to_receive.front();
+		_to_receive.pop_front();
+		_parser.Finish();
+		++_served;
+
+		Complete(tx, ECode::OK);
+		if (_state == State::CLOSED) {
+			return;
+		}
+	}
+
+	if (GetInFlight() == 0) {
+		LOG_DEBUG("Connection closed by server.");
+		Close();
+		return;
+	}
+
+	if (!_parser.IsStarted()) {
+		LOG_DEBUG("Connection closed by server before sending a response.");
+	}
+	else {
+		LOG_DEBUG("Connection closed by server in the middle of a response.");
+	}
+	Fail(ECode::SOCKET_RECV, true);
+}
+
+void HTTPConnection::Receive()
+{
+	while (_parser.HasUnparsed()) {
+		// unsolicited bytes after the responses mean the connection is out of sync
+		if (_to_receive.empty()) {
+			LOG_DEBUG("Unexpected data from server, dropping connection.");
+			Shutdown();
+			return;
+		}
+
+		HTTPTransaction& tx = *_to_receive.front();
+		if (!_parser.GetResponse()) {
+			_parser.Attach(tx.response, tx.method);
+		}
+
+		bool had_headers = _parser.HasHeaders();
+		_parser.Parse();
+
+		if (_parser.HasFailed()) {
+			LOG_ERROR("Malformed response from server.");
+			Fail(ECode::BAD_RESPONSE, false);
+			return;
+		}
+
+		if (!had_headers && _parser.HasHeaders() && tx.on_headers) {
+			tx.on_headers(tx);
+			if (_state != State::OPEN) {
+				return;
+			}
+		}
+
+		if (!_parser.IsDone()) {
+			return;
+		}
+
+		_to_receive.pop_front();
+		_parser.Finish();
+		++_served;
+
+		Complete(tx, ECode::OK);
+		if (_state != State::OPEN) {
+			return;
+		}
+	}
+}
+
+void HTTPConnection::Complete(HTTPTransaction& tx, ECode err)
+{
+	tx.result = err;
+	tx.state = HTTPTransaction::State::DONE;
+
+	if (IsIdle()) {
+		_idle_since = Clock::now();
+	}
+	if (tx.on_complete) {
+		tx.on_complete(tx);
+	}
+}
+
+void HTTPConnection::Fail(ECode err, bool retryable)
+{
+	// nothing was answered for these yet, except maybe the first one being received
+	bool partial = !_to_receive.empty() && _parser.IsStarted();
+	std::deque<HTTPTransaction*> failed;
+
+	failed.insert(failed.end(), _to_receive.begin(), _to_receive.end());
+	failed.insert(failed.end(), _to_send.begin(), _to_send.end());
+	_to_receive.clear();
+	_to_send.clear();
+
+	Close();
+
+	for (size_t i = 0; i < failed.size(); ++i) {
+		HTTPTransaction& tx = *failed[i];
+
+		// a connection that never answered anything is broken, not stale; the server may have
+		// processed a request it got (some of) without answering, only idempotent ones go again
+		tx.retryable = retryable && _served > 0 && !(i == 0 && partial) &&
+			(tx.sent == 0 || RetryPolicy::IsIdempotent(tx.method));
+		Complete(tx, err);
+	}
+}
+
+void HTTPConnection::Close()
+{
+	for (const auto& attempt : _attempts) {
+		_transport.Remove(attempt->GetSocket());
+		closesocket(attempt->GetSocket());
+	}
+	_attempts.clear();
+
+	if (_sockfd != INVALID_SOCKET) {
+		_transport.Remove(_sockfd);
+		closesocket(_sockfd);
+		_sockfd = INVALID_SOCKET;
+	}
+
+	_state = State::CLOSED;
+	_sending = false;
+	_parser.Reset();
+}
+
+HTTPConnection::Attempt::Attempt(HTTPConnection& owner, SOCKET sockfd, size_t address_index) :
+	_owner(owner), _sockfd(sockfd), _address_index(address_index)
+{
+}
+
+SOCKET HTTPConnection::Attempt::GetSocket() const
+{
+	return _sockfd;
+}
+
+size_t HTTPConnection::Attempt::GetAddressIndex() const
+{
+	return _address_index;
+}
+
+void HTTPConnection::Attempt::OnConnect(int result)
+{
+	// may destroy the attempt
+	_owner.OnAttemptConnect(*this, result);
+}
+
+void HTTPConnection::Attempt::OnSend(int)
+{
+}
+
+void HTTPConnection::Attempt::OnRecv(int)
+{
+}
@@ -0,0 +1,210 @@
+#include <HTTP/ConnectionPool.h>
+#include <Logger.h>
+
+#include <algorithm>
+
+ConnectionPool::ConnectionPool(Transport& transport, size_t max_connections, size_t max_idle, Clock::duration idle_timeout,
+	Clock::duration connect_timeout) :
+	_transport(&transport), _preferred(0), _max_connections(max_connections), _max_idle(max_idle), _idle_timeout(idle_timeout),
+	_connect_timeout(connect_timeout)
+{
+}
+
+ConnectionPool::~ConnectionPool()
+{
+	Clear();
+}
+
+void ConnectionPool::SetTransport(Transport& transport)
+{
+	_transport = &transport;
+}
+
+void ConnectionPool::SetAddresses(const Resolver::AddressList& addresses)
+{
+	// a new list means the host moved: idle connections to the old addresses are useless now,
+	// busy ones finish their requests
+	if (_addresses && addresses != _addresses) {
+		for (const auto& conn : _connections) {
+			if (conn->GetInFlight() == 0) {
+				conn->Shutdown();
+			}
+		}
+		_preferred = 0;
+	}
+	_addresses = addresses;
+}
+
+void ConnectionPool::SetLimits(size_t max_idle, Clock::duration idle_timeout)
+{
+	_max_idle = max_idle;
+	_idle_timeout = idle_timeout;
+}
+
+void ConnectionPool::SetConnectTimeout(Clock::duration timeout)
+{
+	_connect_timeout = timeout;
+}
+
+void ConnectionPool::SetMaxConnections(size_t max_connections)
+{
+	_max_connections = std::max<size_t>(max_connections, 1);
+}
+
+ECode ConnectionPool::Acquire(HTTPConnection*& conn, bool pipelinable, size_t pipeline_depth)
+{
+	HTTPConnection* best = nullptr;
+	size_t open_count = 0;
+
+	conn = nullptr;
+
+	// most recently used idle connection first, so the others can age out
+	for (const auto& c : _connections) {
+		if (c->IsIdle() && c->IsAlive() && (!best || c->GetIdleSince() > best->GetIdleSince())) {
+			best = c.get();
+		}
+	}
+
+	// then pre-warmed connections that are still connecting
+	for (const auto& c : _connections) {
+		if (!best && c->GetState() == HTTPConnection::State::CONNECTING && c->GetInFlight() == 0) {
+			best = c.get();
+		}
+		if (c->GetState() != HTTPConnection::State::CLOSED) {
+			++open_count;
+		}
+	}
+
+	if (best) {
+		conn = best;
+		return ECode::OK;
+	}
+
+	if (open_count < _max_connections) {
+		conn = Open();
+		return conn ? ECode::OK : ECode::SOCKET_CONNECT;
+	}
+
+	if (pipelinable) {
+		for (const auto& c : _connections) {
+			if (c->CanPipeline(pipeline_depth) && (!best || c->GetInFlight() < best->GetInFlight())) {
+				best = c.get();
+			}
+		}
+		conn = best;
+	}
+
+	return ECode::OK;
+}
+
+HTTPConnection* ConnectionPool::Open()
+{
+	auto conn = std::make_unique<HTTPConnection>(*_transport);
+
+	if (!conn->Open(_addresses, _preferred, _connect_timeout)) {
+		return nullptr;
+	}
+
+	_connections.push_back(std::move(conn));
+	return _connections.back().get();
+}
+
+size_t ConnectionPool::Prewarm(size_t count)
+{
+	size_t opened = 0;
+
+	while (opened < count && GetIdleCount() + GetConnectingCount() < _max_idle && GetCount() < _max_connections) {
+		if (!Open()) {
+			break;
+		}
+		++opened;
+	}
+
+	return opened;
+}
+
+void ConnectionPool::Evict()
+{
+	auto now = Clock::now();
+	size_t idle = 0;
+
+	// newest first, so the idle limit drops the oldest ones
+	for (auto it = _connections.rbegin(); it != _connections.rend(); ++it) {
+		HTTPConnection& conn = **it;
+
+		if (!conn.IsIdle()) {
+			continue;
+		}
+		if (now - conn.GetIdleSince() > _idle_timeout || ++idle > _max_idle) {
+			LOG_DEBUG("Closing idle connection.");
+			conn.Shutdown();
+		}
+	}
+
+	_connections.remove_if([](const std::unique_ptr<HTTPConnection>& conn) {
+		return conn->GetState() == HTTPConnection::State::CLOSED;
+	});
+}
+
+void ConnectionPool::CheckTimers()
+{
+	auto now = Clock::now();
+
+	for (const auto& conn : _connections) {
+		conn->CheckTimers(now);
+
+		// an address that stalls or refuses is routed around by the next connections too
+		size_t index = conn->GetAddressIndex();
+		if (index != std::string::npos) {
+			_preferred = index;
+		}
+	}
+}
+
+ConnectionPool::Clock::time_point ConnectionPool::GetNextTimer() const
+{
+	auto next = Clock::time_point::max();
+
+	for (const auto& conn : _connections) {
+		next = std::min(next, conn->GetNextTimer());
+	}
+	return next;
+}
+
+void ConnectionPool::Clear()
+{
+	for (const auto& conn : _connections) {
+		conn->Abort(ECode::ABORTED);
+	}
+	_connections.clear();
+}
+
+size_t ConnectionPool::GetCount() const
+{
+	size_t count = 0;
+
+	for (const auto& conn : _connections) {
+		count += conn->GetState() != HTTPConnection::State::CLOSED;
+	}
+	return count;
+}
+
+size_t ConnectionPool::GetIdleCount() const
+{
+	size_t count = 0;
+
+	for (const auto& conn : _connections) {
+		count += conn->IsIdle();
+	}
+	return count;
+}
+
+size_t ConnectionPool::GetConnectingCount() const
+{
+	size_t count = 0;
+
+	for (const auto& conn : _connections) {
+		count += conn->GetState() == HTTPConnection::State::CONNECTING;
+	}
+	return count;
+}
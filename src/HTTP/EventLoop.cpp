@@ -0,0 +1,176 @@
+#include <HTTP/EventLoop.h>
+#include <Logger.h>
+
+#ifndef _WIN32
+static uint32_t ToEpoll(int events)
+{
+	uint32_t ret = 0;
+
+	if (events & EventLoop::EVENT_READ) {
+		ret |= EPOLLIN | EPOLLRDHUP;
+	}
+	if (events & EventLoop::EVENT_WRITE) {
+		ret |= EPOLLOUT;
+	}
+	return ret;
+}
+
+static int FromEpoll(uint32_t events)
+{
+	int ret = EventLoop::EVENT_NONE;
+
+	if (events & (EPOLLIN | EPOLLRDHUP)) {
+		ret |= EventLoop::EVENT_READ;
+	}
+	if (events & EPOLLOUT) {
+		ret |= EventLoop::EVENT_WRITE;
+	}
+	if (events & (EPOLLERR | EPOLLHUP)) {
+		ret |= EventLoop::EVENT_ERROR;
+	}
+	return ret;
+}
+#endif
+
+EventLoop::EventLoop()
+{
+#ifndef _WIN32
+	_epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epfd == -1) {
+		LOG_ERROR("epoll_create1 failed, errno: {}", errno);
+	}
+	_events.resize(MAX_EVENTS);
+#endif
+}
+
+EventLoop::~EventLoop()
+{
+#ifndef _WIN32
+	if (_epfd != -1) {
+		close(_epfd);
+	}
+#endif
+}
+
+bool EventLoop::Add(SOCKET sockfd, int events, Handler* handler)
+{
+#ifndef _WIN32
+	epoll_event ev{};
+	ev.events = ToEpoll(events);
+	ev.data.fd = sockfd;
+
+	if (epoll_ctl(_epfd, EPOLL_CTL_ADD, sockfd, &ev) == -1) {
+		LOG_ERROR("epoll_ctl(ADD) failed, errno: {}", errno);
+		return false;
+	}
+#endif
+
+	_entries[sockfd] = { events, handler };
+	return true;
+}
+
+bool EventLoop::Modify(SOCKET sockfd, int events)
+{
+	auto it = _entries.find(sockfd);
+	if (it == _entries.end()) {
+		return false;
+	}
+	if (it->second.events == events) {
+		return true;
+	}
+
+#ifndef _WIN32
+	epoll_event ev{};
+	ev.events = ToEpoll(events);
+	ev.data.fd = sockfd;
+
+	if (epoll_ctl(_epfd, EPOLL_CTL_MOD, sockfd, &ev) == -1) {
+		LOG_ERROR("epoll_ctl(MOD) failed, errno: {}", errno);
+		return false;
+	}
+#endif
+
+	it->second.events = events;
+	return true;
+}
+
+void EventLoop::Remove(SOCKET sockfd)
+{
+	if (_entries.erase(sockfd) == 0) {
+		return;
+	}
+
+#ifndef _WIN32
+	epoll_ctl(_epfd, EPOLL_CTL_DEL, sockfd, nullptr);
+#endif
+}
+
+int EventLoop::Poll(int timeout_ms)
+{
+	int handled = 0;
+
+#ifdef _WIN32
+	_pollfds.clear();
+	for (const auto& kv : _entries) {
+		WSAPOLLFD pfd{};
+		pfd.fd = kv.first;
+		pfd.events = ((kv.second.events & EVENT_READ) ? POLLRDNORM : 0) | ((kv.second.events & EVENT_WRITE) ? POLLWRNORM : 0);
+		_pollfds.push_back(pfd);
+	}
+
+	if (_pollfds.empty()) {
+		Sleep(timeout_ms < 0 ? 0 : timeout_ms);
+		return 0;
+	}
+
+	int ret = WSAPoll(_pollfds.data(), static_cast<ULONG>(_pollfds.size()), timeout_ms);
+	if (ret == SOCKET_ERROR) {
+		LOG_ERROR("WSAPoll failed, sockerr: {}", SYS_SOCKET_ERROR);
+		return -1;
+	}
+
+	for (const auto& pfd : _pollfds) {
+		int events = EVENT_NONE;
+
+		if (pfd.revents & (POLLRDNORM | POLLHUP)) {
+			events |= EVENT_READ;
+		}
+		if (pfd.revents & POLLWRNORM) {
+			events |= EVENT_WRITE;
+		}
+		if (pfd.revents & (POLLERR | POLLNVAL)) {
+			events |= EVENT_ERROR;
+		}
+
+		auto it = _entries.find(pfd.fd);
+		if (events != EVENT_NONE && it != _entries.end()) {
+			it->second.handler->OnEvent(events);
+			++handled;
+		}
+	}
+#else
+	int ret = epoll_wait(_epfd, _events.data(), static_cast<int>(_events.size()), timeout_ms);
+	if (ret == -1) {
+		if (errno == EINTR) {
+			return 0;
+		}
+		LOG_ERROR("epoll_wait failed, errno: {}", errno);
+		return -1;
+	}
+
+	for (int i = 0; i < ret; ++i) {
+		auto it = _entries.find(_events[i].data.fd);
+		if (it != _entries.end()) {
+			it->second.handler->OnEvent(FromEpoll(_events[i].events));
+			++handled;
+		}
+	}
+#endif
+
+	return handled;
+}
+
+size_t EventLoop::GetCount() const
+{
+	return _entries.size();
+}
@@ -0,0 +1,237 @@
+#include <HTTP/HeaderScan.h>
+
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#define HEADER_SCAN_X86
+
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define HEADER_SCAN_TARGET(isa)
+	#else
+		#define HEADER_SCAN_TARGET(isa) __attribute__((target(isa)))
+	#endif
+
+	#include <immintrin.h>
+	#include <nmmintrin.h>
+#endif
+
+namespace
+{
+	constexpr size_t NPOS = std::string::npos;
+
+	size_t FindLineEndScalar(const char* data, size_t len, size_t& colon)
+	{
+		colon = NPOS;
+
+		for (size_t i = 0; i < len; ++i) {
+			if (data[i] == '\n') {
+				return i;
+			}
+			if (data[i] == ':' && colon == NPOS) {
+				colon = i;
+			}
+		}
+		return NPOS;
+	}
+
+#ifdef HEADER_SCAN_X86
+	inline unsigned CountTrailingZeros(unsigned mask)
+	{
+	#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+	#else
+		return __builtin_ctz(mask);
+	#endif
+	}
+
+	// 16 bytes at a time, pcmpestri finds the first of "\n:" in each block
+	HEADER_SCAN_TARGET("sse4.2")
+	size_t FindLineEndSse42(const char* data, size_t len, size_t& colon)
+	{
+		const __m128i both = _mm_setr_epi8('\n', ':', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m128i newline = _mm_setr_epi8('\n', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		size_t i = 0;
+
+		colon = NPOS;
+
+		while (i + 16 <= len) {
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			int index;
+
+			// once the colon is known, only the line end matters
+			if (colon == NPOS) {
+				index = _mm_cmpestri(both, 2, block, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+				if (index == 16) {
+					i += 16;
+					continue;
+				}
+				if (data[i + index] == '\n') {
+					return i + index;
+				}
+
+				colon = i + index;
+				i += index + 1;
+				continue;
+			}
+
+			index = _mm_cmpestri(newline, 1, block, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+			if (index != 16) {
+				return i + index;
+			}
+			i += 16;
+		}
+
+		size_t tail_colon;
+		size_t end = FindLineEndScalar(data + i, len - i, tail_colon);
+
+		if (colon == NPOS && tail_colon != NPOS) {
+			colon = i + tail_colon;
+		}
+		return end != NPOS ? i + end : NPOS;
+	}
+
+	// 32 bytes at a time, one bit per byte for each delimiter
+	HEADER_SCAN_TARGET("avx2")
+	size_t FindLineEndAvx2(const char* data, size_t len, size_t& colon)
+	{
+		const __m256i newline = _mm256_set1_epi8('\n');
+		const __m256i colons = _mm256_set1_epi8(':');
+		size_t i = 0;
+
+		colon = NPOS;
+
+		for (; i + 32 <= len; i += 32) {
+			__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+			unsigned nl_mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+			unsigned colon_mask = colon == NPOS ? static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, colons))) : 0;
+
+			if (nl_mask) {
+				unsigned end = CountTrailingZeros(nl_mask);
+
+				// only a colon before the line end counts
+				colon_mask &= (1u << end) - 1;
+				if (colon_mask) {
+					colon = i + CountTrailingZeros(colon_mask);
+				}
+				return i + end;
+			}
+			if (colon_mask) {
+				colon = i + CountTrailingZeros(colon_mask);
+			}
+		}
+
+		size_t tail_colon;
+		size_t end = FindLineEndScalar(data + i, len - i, tail_colon);
+
+		if (colon == NPOS && tail_colon != NPOS) {
+			colon = i + tail_colon;
+		}
+		return end != NPOS ? i + end : NPOS;
+	}
+
+	bool CpuSupports(HeaderScan::Impl impl)
+	{
+	#ifdef _MSC_VER
+		int regs[4];
+
+		__cpuid(regs, 1);
+		bool sse42 = (regs[2] >> 20) & 1;
+		// AVX2 also needs the OS to save the YMM registers
+		bool ymm = ((regs[2] >> 27) & 1) && (_xgetbv(0) & 6) == 6;
+		__cpuidex(regs, 7, 0);
+		bool avx2 = ymm && ((regs[1] >> 5) & 1);
+	#else
+		__builtin_cpu_init();
+		bool sse42 = __builtin_cpu_supports("sse4.2");
+		bool avx2 = __builtin_cpu_supports("avx2");
+	#endif
+
+		switch (impl) {
+		case HeaderScan::Impl::SSE42: return sse42;
+		case HeaderScan::Impl::AVX2:  return avx2;
+		default: return true;
+		}
+	}
+#endif
+
+	using ScanFunction = size_t (*)(const char*, size_t, size_t&);
+
+	struct Dispatch {
+		HeaderScan::Impl impl;
+		ScanFunction scan;
+	};
+
+	Dispatch Detect()
+	{
+#ifdef HEADER_SCAN_X86
+		if (CpuSupports(HeaderScan::Impl::AVX2)) {
+			return { HeaderScan::Impl::AVX2, FindLineEndAvx2 };
+		}
+		if (CpuSupports(HeaderScan::Impl::SSE42)) {
+			return { HeaderScan::Impl::SSE42, FindLineEndSse42 };
+		}
+#endif
+		return { HeaderScan::Impl::SCALAR, FindLineEndScalar };
+	}
+
+	Dispatch& GetDispatch()
+	{
+		static Dispatch dispatch = Detect();
+		return dispatch;
+	}
+}
+
+namespace HeaderScan
+{
+	size_t FindLineEnd(const char* data, size_t len, size_t& colon)
+	{
+		return GetDispatch().scan(data, len, colon);
+	}
+
+	Impl GetImpl()
+	{
+		return GetDispatch().impl;
+	}
+
+	const char* GetImplName()
+	{
+		switch (GetImpl()) {
+		case Impl::AVX2:  return "avx2";
+		case Impl::SSE42: return "sse4.2";
+		default:          return "scalar";
+		}
+	}
+
+	bool SetImpl(Impl impl)
+	{
+		Dispatch& dispatch = GetDispatch();
+
+		switch (impl) {
+#ifdef HEADER_SCAN_X86
+		case Impl::AVX2:
+			if (!CpuSupports(impl)) {
+				return false;
+			}
+			dispatch = { impl, FindLineEndAvx2 };
+			return true;
+
+		case Impl::SSE42:
+			if (!CpuSupports(impl)) {
+				return false;
+			}
+			dispatch = { impl, FindLineEndSse42 };
+			return true;
+#endif
+		case Impl::SCALAR:
+			dispatch = { impl, FindLineEndScalar };
+			return true;
+
+		default:
+			return false;
+		}
+	}
+}
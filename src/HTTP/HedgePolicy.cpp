@@ -0,0 +1,79 @@
+#include <HTTP/HedgePolicy.h>
+
+#include <algorithm>
+
+HedgePolicy::HedgePolicy() :
+	_enabled(false), _percentile(PERCENTILE), _min_delay(MIN_DELAY), _min_samples(MIN_SAMPLES), _next_sample(0)
+{
+}
+
+void HedgePolicy::SetEnabled(bool enable)
+{
+	_enabled = enable;
+}
+
+bool HedgePolicy::IsEnabled() const
+{
+	return _enabled;
+}
+
+void HedgePolicy::SetPercentile(double percentile)
+{
+	_percentile = std::clamp(percentile, 0.0, 1.0);
+}
+
+void HedgePolicy::SetMinDelay(Clock::duration delay)
+{
+	_min_delay = delay;
+}
+
+void HedgePolicy::SetMinSamples(size_t count)
+{
+	_min_samples = std::clamp<size_t>(count, 1, SAMPLE_COUNT);
+}
+
+void HedgePolicy::AddPath(const std::string& prefix)
+{
+	_paths.push_back(prefix);
+}
+
+bool HedgePolicy::ShouldHedge(const std::string& method, const std::string& path) const
+{
+	if (!_enabled || (method != "GET" && method != "HEAD")) {
+		return false;
+	}
+
+	if (_paths.empty()) {
+		return true;
+	}
+
+	return std::any_of(_paths.begin(), _paths.end(), [&](const std::string& prefix) {
+		return path.compare(0, prefix.size(), prefix) == 0;
+	});
+}
+
+bool HedgePolicy::GetDelay(Clock::duration& delay) const
+{
+	if (_samples.size() < _min_samples) {
+		return false;
+	}
+
+	// a copy, the samples stay in arrival order for the ring buffer
+	std::vector<Clock::duration> sorted = _samples;
+	auto nth = sorted.begin() + static_cast<size_t>(_percentile * (sorted.size() - 1));
+	std::nth_element(sorted.begin(), nth, sorted.end());
+
+	delay = std::max(*nth, _min_delay);
+	return true;
+}
+
+void HedgePolicy::AddSample(Clock::duration latency)
+{
+	if (_samples.size() < SAMPLE_COUNT) {
+		_samples.push_back(latency);
+		return;
+	}
+
+	_samples[_next_sample] = latency;
+	_next_sample = (_next_sample + 1) % SAMPLE_COUNT;
+}
@@ -0,0 +1,435 @@
+#include <HTTP/Parser.h>
+#include <HTTP/HeaderScan.h>
+#include <Logger.h>
+#include <Utils.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+
+namespace
+{
+	std::string_view TrimView(std::string_view str)
+	{
+		while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+			str.remove_prefix(1);
+		}
+		while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+			str.remove_suffix(1);
+		}
+		return str;
+	}
+
+	bool ContainsNoCase(std::string_view str, std::string_view token)
+	{
+		auto it = std::search(str.begin(), str.end(), token.begin(), token.end(), [](char a, char b) {
+			return std::tolower(static_cast<unsigned char>(a)) == b;
+		});
+		return it != str.end();
+	}
+}
+
+HTTPParser::HTTPParser() :
+	_response(nullptr), _state(State::IDLE), _head(false), _length(0), _pos(0), _line_start(0),
+	_colon(std::string::npos), _remaining(0), _content_length(std::string::npos), _chunked(false), _trailers_length(0)
+{
+}
+
+void HTTPParser::Reset()
+{
+	if (_response) {
+		_response->_receiving = nullptr;
+	}
+
+	_response = nullptr;
+	_state = State::IDLE;
+	_buffer.clear();
+	_length = _pos = _line_start = 0;
+}
+
+void HTTPParser::Attach(HTTPResponse* response, std::string_view method)
+{
+	_response = response;
+	_head = method == "HEAD";
+	Start();
+}
+
+void HTTPParser::Start()
+{
+	_state = State::STATUS_LINE;
+	_pos = _line_start = 0;
+	_remaining = 0;
+	_content_length = std::string::npos;
+	_chunked = false;
+	_trailers_length = 0;
+
+	// the fields keep their capacity when a response is reused, so parsing rarely allocates
+	_response->Reset();
+	_response->_header_fields.reserve(INITIAL_FIELDS);
+	_response->_receiving = &_buffer;
+}
+
+char* HTTPParser::GetRecvBuffer(size_t& len)
+{
+	size_t want = MIN_RECV_SIZE;
+
+	// room for the whole body, so it comes in with as few receives as possible
+	if (_state == State::BODY && _remaining != std::string::npos) {
+		want = std::max(want, std::min(_remaining, MAX_PREALLOC_SIZE));
+	}
+
+	if (_buffer.size() - _length < want) {
+		_buffer.resize(_length + want);
+	}
+
+	len = _buffer.size() - _length;
+	return &_buffer[_length];
+}
+
+void HTTPParser::Commit(size_t len)
+{
+	_length += len;
+}
+
+void HTTPParser::Parse()
+{
+	while (_pos < _length && _state != State::IDLE && _state != State::DONE && _state != State::FAILED) {
+		char* data = &_buffer[0];
+		size_t avail = _length - _pos;
+
+		// body bytes stay where they are, whatever they contain
+		if (_state == State::BODY) {
+			size_t n = std::min(avail, _remaining);
+
+			_pos += n;
+			_response->_body_length += n;
+
+			if (_remaining != std::string::npos) {
+				_remaining -= n;
+			}
+			if (_remaining == 0) {
+				_state = State::DONE;
+			}
+			continue;
+		}
+
+		if (_state == State::CHUNK_DATA) {
+			size_t n = std::min(avail, _remaining);
+			size_t body_end = _response->_body_offset + _response->_body_length;
+
+			if (body_end != _pos) {
+				memmove(data + body_end, data + _pos, n);
+			}
+			_pos += n;
+			_line_start = _pos;
+			_response->_body_length += n;
+
+			_remaining -= n;
+			if (_remaining == 0) {
+				_state = State::CHUNK_DATA_END;
+			}
+			continue;
+		}
+
+		// everything else is line based; lines are parsed in place. the scan also finds the
+		// header colon, which is remembered when a line spans several receives
+		if (_pos == _line_start) {
+			_colon = std::string::npos;
+		}
+
+		size_t colon;
+		size_t nl = HeaderScan::FindLineEnd(data + _pos, avail, colon);
+
+		if (colon != std::string::npos && _colon == std::string::npos) {
+			_colon = _pos + colon;
+		}
+		if (nl == std::string::npos) {
+			_pos = _length;
+			if (_pos - _line_start > MAX_LINE_LENGTH) {
+				LOG_ERROR("HTTP response line too long.");
+				_state = State::FAILED;
+			}
+			break;
+		}
+		_pos += nl + 1;
+
+		std::string_view line(data + _line_start, _pos - _line_start - 1);
+		if (!line.empty() && line.back() == '\r') {
+			line.remove_suffix(1);
+		}
+		colon = _colon != std::string::npos ? _colon - _line_start : std::string::npos;
+		_line_start = _pos;
+
+		if (!OnLine(line, colon)) {
+			_state = State::FAILED;
+		}
+	}
+}
+
+bool HTTPParser::FinishEof()
+{
+	// no content-length and not chunked: the body ends with the connection
+	if (_state == State::BODY && _remaining == std::string::npos) {
+		_state = State::DONE;
+	}
+	return _state == State::DONE;
+}
+
+void HTTPParser::Finish()
+{
+	// a decoded chunked body (and its trailers) ends before the chunk framing that followed it
+	size_t end = _chunked ? _response->_body_offset + _response->_body_length + _trailers_length : _pos;
+	std::string next;
+
+	// only pipelined responses leave anything behind
+	if (_pos < _length) {
+		next.assign(_buffer, _pos, _length - _pos);
+	}
+
+	_buffer.resize(end);
+	_response->_raw = std::move(_buffer);
+	_response->_receiving = nullptr;
+
+	_buffer = std::move(next);
+	_length = _buffer.size();
+	_pos = _line_start = 0;
+
+	_response = nullptr;
+	_state = State::IDLE;
+}
+
+HTTPParser::State HTTPParser::GetState() const
+{
+	return _state;
+}
+
+HTTPResponse* HTTPParser::GetResponse() const
+{
+	return _response;
+}
+
+bool HTTPParser::HasUnparsed() const
+{
+	return _pos < _length;
+}
+
+bool HTTPParser::IsStarted() const
+{
+	return _length > 0;
+}
+
+bool HTTPParser::HasHeaders() const
+{
+	return _state >= State::BODY && _state != State::FAILED;
+}
+
+bool HTTPParser::IsDone() const
+{
+	return _state == State::DONE;
+}
+
+bool HTTPParser::HasFailed() const
+{
+	return _state == State::FAILED;
+}
+
+bool HTTPParser::OnLine(std::string_view line, size_t colon)
+{
+	switch (_state) {
+	case State::STATUS_LINE:
+		// stray empty lines before the status line are allowed
+		return line.empty() || OnStatusLine(line);
+
+	case State::HEADERS:
+		return line.empty() ? OnHeadersEnd() : OnHeader(line, colon);
+
+	case State::CHUNK_SIZE:
+		return OnChunkSize(line);
+
+	case State::CHUNK_DATA_END:
+		_state = State::CHUNK_SIZE;
+		return line.empty();
+
+	case State::TRAILERS:
+		if (line.empty()) {
+			_state = State::DONE;
+			return true;
+		}
+		return OnTrailer(line, colon);
+
+	default:
+		return false;
+	}
+}
+
+bool HTTPParser::OnStatusLine(std::string_view line)
+{
+	int code = 0;
+
+	// HTTP-version SP status-code SP [reason-phrase]
+	size_t sp = line.find(' ');
+	if (sp == std::string_view::npos || line.compare(0, 5, "HTTP/") != 0) {
+		LOG_ERROR("Invalid HTTP status line.");
+		return false;
+	}
+	_response->_protover.assign(line.substr(0, sp));
+	line.remove_prefix(sp + 1);
+
+	auto [end, ec] = std::from_chars(line.data(), line.data() + line.size(), code);
+	if (ec != std::errc() || end != line.data() + 3) {
+		LOG_ERROR("Invalid HTTP status code.");
+		return false;
+	}
+	_response->_code = code;
+	line.remove_prefix(3);
+
+	if (!line.empty() && line.front() == ' ') {
+		line.remove_prefix(1);
+	}
+	_response->_status.assign(line);
+
+	_state = State::HEADERS;
+	return true;
+}
+
+bool HTTPParser::SplitHeader(std::string_view line, size_t colon, std::string_view& key, std::string_view& val)
+{
+	if (colon == std::string_view::npos || colon == 0) {
+		return false;
+	}
+
+	key = line.substr(0, colon);
+	val = TrimView(line.substr(colon + 1));
+	return true;
+}
+
+void HTTPParser::AddField(std::vector<HTTPResponse::FieldRef>& fields, std::string_view key, std::string_view val)
+{
+	const char* base = _buffer.data();
+
+	fields.push_back({
+		static_cast<uint32_t>(key.data() - base), static_cast<uint32_t>(key.size()),
+		static_cast<uint32_t>(val.data() - base), static_cast<uint32_t>(val.size())
+	});
+	_response->_headers.Reset();
+	_response->_cookies.Reset();
+}
+
+bool HTTPParser::OnHeader(std::string_view line, size_t colon)
+{
+	std::string_view key, val;
+
+	if (!SplitHeader(line, colon, key, val)) {
+		return true;
+	}
+
+	if (Utils::EqualsNoCase(key, "set-cookie")) {
+		size_t eq = val.find('=');
+
+		if (eq != std::string_view::npos) {
+			std::string_view cookie_val = val.substr(eq + 1);
+			cookie_val = cookie_val.substr(0, cookie_val.find(';'));
+
+			AddField(_response->_cookie_fields, val.substr(0, eq), cookie_val);
+		}
+		return true;
+	}
+
+	if (Utils::EqualsNoCase(key, "content-length")) {
+		auto [end, ec] = std::from_chars(val.data(), val.data() + val.size(), _content_length);
+		if (ec != std::errc() || end != val.data() + val.size()) {
+			LOG_ERROR("Invalid content-length: {}", std::string(val));
+			return false;
+		}
+	}
+	else if (Utils::EqualsNoCase(key, "transfer-encoding") && ContainsNoCase(val, "chunked")) {
+		_chunked = true;
+	}
+
+	AddField(_response->_header_fields, key, val);
+	return true;
+}
+
+bool HTTPParser::OnTrailer(std::string_view line, size_t colon)
+{
+	std::string_view key, val;
+
+	// trailers end up with the other headers, except the ones that can't be sent
+	// after the body (framing, cookies)
+	if (!SplitHeader(line, colon, key, val) || Utils::EqualsNoCase(key, "content-length") ||
+		Utils::EqualsNoCase(key, "transfer-encoding") || Utils::EqualsNoCase(key, "set-cookie")) {
+		return true;
+	}
+
+	// the chunk framing around it is dropped with the response, keep the line right after the body
+	char* base = &_buffer[0];
+	size_t line_offset = line.data() - base;
+	size_t line_length = _pos - line_offset;
+	size_t dest = _response->_body_offset + _response->_body_length + _trailers_length;
+
+	memmove(base + dest, base + line_offset, line_length);
+	_trailers_length += line_length;
+
+	key = std::string_view(base + dest + (key.data() - line.data()), key.size());
+	val = std::string_view(base + dest + (val.data() - line.data()), val.size());
+	AddField(_response->_header_fields, key, val);
+	return true;
+}
+
+bool HTTPParser::OnHeadersEnd()
+{
+	int code = _response->_code;
+
+	// interim responses (eg: 100 continue) are followed by the real one
+	if (code >= 100 && code < 200 && code != 101) {
+		_buffer.erase(0, _pos);
+		_length -= _pos;
+		Start();
+		return true;
+	}
+
+	_response->_body_offset = _pos;
+
+	// 1xx, 204 and 304 never have a body, nor does the answer to a HEAD (its content-length
+	// is the one a GET would get)
+	if (_head || code < 200 || code == 204 || code == 304) {
+		_state = State::DONE;
+	}
+	else if (_chunked) {
+		_state = State::CHUNK_SIZE;
+	}
+	else if (_content_length != std::string::npos) {
+		_remaining = _content_length;
+		_state = _remaining ? State::BODY : State::DONE;
+	}
+	else {
+		_remaining = std::string::npos;
+		_state = State::BODY;
+	}
+
+	return true;
+}
+
+bool HTTPParser::OnChunkSize(std::string_view line)
+{
+	size_t chunk_size = 0;
+
+	// chunk-size [; ext]
+	line = TrimView(line.substr(0, line.find(';')));
+
+	auto [end, ec] = std::from_chars(line.data(), line.data() + line.size(), chunk_size, 16);
+	if (ec != std::errc() || end != line.data() + line.size()) {
+		LOG_ERROR("Invalid chunk size.");
+		return false;
+	}
+
+	if (chunk_size == 0) {
+		_state = State::TRAILERS;
+	}
+	else {
+		_remaining = chunk_size;
+		_state = State::CHUNK_DATA;
+	}
+	return true;
+}
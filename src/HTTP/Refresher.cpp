@@ -0,0 +1,137 @@
+#include <HTTP/Refresher.h>
+#include <Logger.h>
+
+HTTPRefresher::HTTPRefresher(HTTPClient& client, const std::string& path, Clock::duration interval) :
+	_client(client), _path(path), _interval(interval), _stop(false), _refresh(false), _generation(0)
+{
+	// Stop() cancels the refreshes only, not the other requests on the client
+	_deadline.total = REFRESH_TIMEOUT;
+	_deadline.cancel = &_cancel;
+}
+
+HTTPRefresher::~HTTPRefresher()
+{
+	Stop();
+}
+
+void HTTPRefresher::SetInterval(Clock::duration interval)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// takes effect after the current wait
+	_interval = interval;
+}
+
+HTTPRefresher::Clock::duration HTTPRefresher::GetInterval() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _interval;
+}
+
+void HTTPRefresher::SetHeaders(const SMap& headers)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (headers == _headers) {
+		return;
+	}
+
+	_headers = headers;
+	_snapshot = nullptr;
+	++_generation;
+	_refresh = true;
+	_cond.notify_all();
+}
+
+void HTTPRefresher::Start()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_thread.joinable()) {
+		return;
+	}
+
+	_stop = false;
+	_refresh = true;
+	_cancel.Reset();
+	_thread = std::thread(&HTTPRefresher::Worker, this);
+}
+
+void HTTPRefresher::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (!_thread.joinable()) {
+			return;
+		}
+		_stop = true;
+	}
+
+	_cancel.Cancel();
+	_cond.notify_all();
+	_thread.join();
+}
+
+bool HTTPRefresher::IsRunning() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _thread.joinable() && !_stop;
+}
+
+void HTTPRefresher::Refresh(bool invalidate)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (invalidate) {
+		_snapshot = nullptr;
+		++_generation;
+	}
+	_refresh = true;
+	_cond.notify_all();
+}
+
+std::shared_ptr<const HTTPRefresher::Snapshot> HTTPRefresher::GetSnapshot() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _snapshot;
+}
+
+void HTTPRefresher::Worker()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (true) {
+		auto woken = [this] { return _stop || _refresh; };
+		if (_interval == Clock::duration::zero()) {
+			_cond.wait(lock, woken);
+		}
+		else {
+			_cond.wait_for(lock, _interval, woken);
+		}
+		if (_stop) {
+			break;
+		}
+
+		SMap headers = _headers;
+		uint64_t generation = _generation;
+		_refresh = false;
+		lock.unlock();
+
+		auto snapshot = std::make_shared<Snapshot>();
+		ECode err = _client.Get(snapshot->response, _path, SMap(), headers, SMap(), &_deadline);
+		snapshot->fetched = Clock::now();
+
+		lock.lock();
+		if (err != ECode::OK || snapshot->response.GetCode() != 200) {
+			LOG_DEBUG("Couldn't refresh {} (errcode: {}, status: {}), keeping the old copy.",
+				_path, err, snapshot->response.GetCode());
+			continue;
+		}
+		if (generation != _generation) {
+			continue;
+		}
+
+		_snapshot = std::move(snapshot);
+	}
+}
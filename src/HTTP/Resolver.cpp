@@ -0,0 +1,228 @@
+#include <HTTP/Resolver.h>
+#include <Logger.h>
+
+#include <algorithm>
+#include <cstring>
+
+Resolver::Resolver(const std::string& host, int port, Clock::duration ttl) :
+	_host(host), _port(port), _requested(false), _resolving(false), _stopping(false), _lookups(0),
+	_error(ECode::OK), _ttl(ttl), _expires()
+{
+}
+
+Resolver::~Resolver()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_cond.notify_all();
+
+	if (_thread.joinable()) {
+		_thread.join();
+	}
+}
+
+void Resolver::SetTtl(Clock::duration ttl)
+{
+	// used from the next lookup on
+	std::lock_guard<std::mutex> lock(_mutex);
+	_ttl = ttl;
+}
+
+void Resolver::SetOnResolved(std::function<void()> on_resolved)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_on_resolved = std::move(on_resolved);
+}
+
+void Resolver::Refresh()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	RefreshLocked(false);
+}
+
+void Resolver::RefreshLocked(bool queue)
+{
+	if (_requested || (_resolving && !queue)) {
+		return;
+	}
+
+	// the thread is started by the first lookup, the client may never need it
+	if (!_thread.joinable()) {
+		_thread = std::thread(&Resolver::Worker, this);
+	}
+
+	_requested = true;
+	_cond.notify_all();
+}
+
+ECode Resolver::Resolve(AddressList& addresses)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	// a lookup already running may have started before whatever made the caller ask
+	size_t target = _lookups + (_resolving ? 2 : 1);
+
+	RefreshLocked(true);
+	_cond.wait(lock, [&] { return _lookups >= target || _stopping; });
+
+	if (_error == ECode::OK) {
+		addresses = _addresses;
+	}
+	return _error;
+}
+
+ECode Resolver::GetAddresses(AddressList& addresses)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	if (IsExpired() || !_addresses) {
+		RefreshLocked(false);
+	}
+
+	// only waits while no lookup succeeded yet
+	if (!_addresses) {
+		size_t target = _lookups + 1;
+		_cond.wait(lock, [&] { return _lookups >= target || _stopping; });
+
+		if (!_addresses) {
+			return _error != ECode::OK ? _error : ECode::HOST_NORESULT;
+		}
+	}
+
+	addresses = _addresses;
+	return ECode::OK;
+}
+
+bool Resolver::TryGetAddresses(AddressList& addresses)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (IsExpired()) {
+		RefreshLocked(false);
+	}
+	if (!_addresses) {
+		return false;
+	}
+
+	addresses = _addresses;
+	return true;
+}
+
+bool Resolver::HasAddress() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _addresses != nullptr;
+}
+
+bool Resolver::IsResolving() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _requested || _resolving;
+}
+
+ECode Resolver::GetError() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _error;
+}
+
+bool Resolver::IsExpired() const
+{
+	// also true before the first lookup
+	return Clock::now() >= _expires;
+}
+
+void Resolver::Worker()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (true) {
+		_cond.wait(lock, [this] { return _requested || _stopping; });
+		if (_stopping) {
+			return;
+		}
+
+		_requested = false;
+		_resolving = true;
+
+		// getaddrinfo may take a while, nobody waits on the lock meanwhile
+		std::vector<SysAddress> addresses;
+		lock.unlock();
+		ECode err = Lookup(_host, _port, addresses);
+		lock.lock();
+
+		_resolving = false;
+		_error = err;
+		++_lookups;
+
+		if (err == ECode::OK) {
+			if (!_addresses || *_addresses != addresses) {
+				LOG_DEBUG("Server has {} address(es) now.", addresses.size());
+				_addresses = std::make_shared<const std::vector<SysAddress>>(std::move(addresses));
+			}
+			_expires = Clock::now() + _ttl;
+		}
+		else {
+			// stale addresses are still better than none
+			LOG_WARNING("Couldn't resolve host, errcode: {}", err);
+			_expires = Clock::now() + RETRY_AFTER;
+		}
+
+		_cond.notify_all();
+		if (_on_resolved) {
+			_on_resolved();
+		}
+	}
+}
+
+ECode Resolver::Lookup(const std::string& host, int port, std::vector<SysAddress>& addresses)
+{
+	std::vector<SysAddress> by_family[2];
+	int ret;
+
+	struct addrinfo* result = nullptr;
+	struct addrinfo hints {};
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	ret = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
+	if (ret != 0) {
+		return ECode::HOST_ADDRINFO;
+	}
+
+	// getaddrinfo already sorts them by preference (RFC 6724), the family of the first one goes first
+	int first_family = result ? result->ai_family : AF_INET6;
+
+	for (struct addrinfo* ptr = result; ptr != nullptr; ptr = ptr->ai_next) {
+		if ((ptr->ai_family != AF_INET && ptr->ai_family != AF_INET6) || ptr->ai_socktype != SOCK_STREAM ||
+			ptr->ai_addrlen > sizeof(sockaddr_storage)) {
+			continue;
+		}
+
+		SysAddress address{};
+		memcpy(&address.storage, ptr->ai_addr, ptr->ai_addrlen);
+		address.length = static_cast<socklen_t>(ptr->ai_addrlen);
+
+		auto& list = by_family[ptr->ai_family == first_family ? 0 : 1];
+		if (std::find(list.begin(), list.end(), address) == list.end()) {
+			list.push_back(address);
+		}
+	}
+	freeaddrinfo(result);
+
+	// alternate the families (RFC 8305), so a broken one only delays the first attempt
+	addresses.clear();
+	for (size_t i = 0; i < std::max(by_family[0].size(), by_family[1].size()); ++i) {
+		for (const auto& list : by_family) {
+			if (i < list.size()) {
+				addresses.push_back(list[i]);
+			}
+		}
+	}
+
+	return addresses.empty() ? ECode::HOST_NORESULT : ECode::OK;
+}
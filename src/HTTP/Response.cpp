@@ -1,13 +1,25 @@
 #include <HTTP/Response.h>
+#include <Utils.h>
+
+HTTPResponse::HTTPResponse()
+{
+	Reset();
+}
 
 void HTTPResponse::Reset()
 {
 	_protover.clear();
 	_code = 0;
 	_status.clear();
-	_headers.clear();
-	_cookies.clear();
-	_data.clear();
+	_header_fields.clear();
+	_cookie_fields.clear();
+	_headers.Reset();
+	_cookies.Reset();
+	_body_offset = 0;
+	_body_length = 0;
+	_data.Reset();
+	_raw.clear();
+	_receiving = nullptr;
 }
 
 int HTTPResponse::GetCode() const
@@ -20,22 +32,97 @@ const std::string& HTTPResponse::GetStatus() const
 	return _status;
 }
 
+std::optional<std::string_view> HTTPResponse::GetHeader(std::string_view name) const
+{
+	return Find(_header_fields, name);
+}
+
+std::optional<std::string_view> HTTPResponse::GetCookie(std::string_view name) const
+{
+	return Find(_cookie_fields, name);
+}
+
+size_t HTTPResponse::GetHeaderCount() const
+{
+	return _header_fields.size();
+}
+
+HTTPResponse::Field HTTPResponse::GetHeaderAt(size_t index) const
+{
+	return Resolve(_header_fields[index]);
+}
+
+size_t HTTPResponse::GetCookieCount() const
+{
+	return _cookie_fields.size();
+}
+
+HTTPResponse::Field HTTPResponse::GetCookieAt(size_t index) const
+{
+	return Resolve(_cookie_fields[index]);
+}
+
 const SMap& HTTPResponse::GetHeaders() const
-{ 
-	return _headers;
+{
+	return _headers.Get([this](SMap& headers) {
+		for (const auto& ref : _header_fields) {
+			Field field = Resolve(ref);
+			headers[Utils::ToLower(std::string(field.name))] = std::string(field.value);
+		}
+	});
 }
 
 const SMap& HTTPResponse::GetCookies() const
 {
-	return _cookies;
+	return _cookies.Get([this](SMap& cookies) {
+		for (const auto& ref : _cookie_fields) {
+			Field field = Resolve(ref);
+			cookies[std::string(field.name)] = std::string(field.value);
+		}
+	});
+}
+
+std::string_view HTTPResponse::GetBody() const
+{
+	const std::string& storage = GetStorage();
+
+	if (_body_offset + _body_length > storage.size()) {
+		return std::string_view();
+	}
+	return std::string_view(storage).substr(_body_offset, _body_length);
 }
 
 const std::string& HTTPResponse::GetData() const
 {
-	return _data;
+	return _data.Get([this](std::string& data) {
+		data.assign(GetBody());
+	});
 }
 
 const std::string& HTTPResponse::GetRaw() const
 {
 	return _raw;
 }
+
+const std::string& HTTPResponse::GetStorage() const
+{
+	return _receiving ? *_receiving : _raw;
+}
+
+HTTPResponse::Field HTTPResponse::Resolve(const FieldRef& ref) const
+{
+	std::string_view storage = GetStorage();
+
+	return { storage.substr(ref.name_offset, ref.name_length), storage.substr(ref.value_offset, ref.value_length) };
+}
+
+std::optional<std::string_view> HTTPResponse::Find(const std::vector<FieldRef>& fields, std::string_view name) const
+{
+	for (auto it = fields.rbegin(); it != fields.rend(); ++it) {
+		Field field = Resolve(*it);
+		if (Utils::EqualsNoCase(field.name, name)) {
+			return field.value;
+		}
+	}
+	return std::nullopt;
+}
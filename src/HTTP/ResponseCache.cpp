@@ -0,0 +1,114 @@
+#include <HTTP/ResponseCache.h>
+#include <Logger.h>
+
+#include <iterator>
+#include <string_view>
+
+ResponseCache::ResponseCache() :
+	_max_bytes(0), _size(0)
+{
+}
+
+void ResponseCache::SetMaxBytes(size_t max_bytes)
+{
+	_max_bytes = max_bytes;
+	Evict(_max_bytes);
+}
+
+size_t ResponseCache::GetMaxBytes() const
+{
+	return _max_bytes;
+}
+
+size_t ResponseCache::GetSize() const
+{
+	return _size;
+}
+
+std::shared_ptr<const HTTPResponse> ResponseCache::Find(const std::string& key)
+{
+	auto it = _index.find(key);
+
+	if (it == _index.end()) {
+		return nullptr;
+	}
+
+	_entries.splice(_entries.begin(), _entries, it->second);
+	return it->second->response;
+}
+
+void ResponseCache::Store(const std::string& key, const HTTPResponse& response)
+{
+	Remove(key);
+
+	if (!response.GetHeader("etag") && !response.GetHeader("last-modified")) {
+		return;
+	}
+
+	auto cache_control = response.GetHeader("cache-control");
+	if (cache_control && cache_control->find("no-store") != std::string_view::npos) {
+		return;
+	}
+
+	// the key and the bookkeeping count too, so lots of tiny responses can't grow it unbounded
+	size_t size = response.GetRaw().size() + key.size() + sizeof(Entry);
+	if (size > _max_bytes) {
+		return;
+	}
+
+	Evict(_max_bytes - size);
+
+	_entries.push_front(Entry{ key, std::make_shared<const HTTPResponse>(response), size });
+	_index[key] = _entries.begin();
+	_size += size;
+}
+
+void ResponseCache::Remove(const std::string& key)
+{
+	auto it = _index.find(key);
+
+	if (it == _index.end()) {
+		return;
+	}
+
+	_size -= it->second->size;
+	_entries.erase(it->second);
+	_index.erase(it);
+}
+
+void ResponseCache::Clear()
+{
+	_entries.clear();
+	_index.clear();
+	_size = 0;
+}
+
+void ResponseCache::AddValidators(const HTTPResponse& cached, std::string& headers)
+{
+	std::string validators;
+
+	auto etag = cached.GetHeader("etag");
+	if (etag) {
+		fmt::format_to(std::back_inserter(validators), "if-none-match: {}\r\n", *etag);
+	}
+
+	auto last_modified = cached.GetHeader("last-modified");
+	if (last_modified) {
+		fmt::format_to(std::back_inserter(validators), "if-modified-since: {}\r\n", *last_modified);
+	}
+
+	// the block ends with the empty line
+	headers.insert(headers.size() - 2, validators);
+}
+
+void ResponseCache::Evict(size_t max_bytes)
+{
+	while (_size > max_bytes) {
+		// the key ends with the authorization, which stays out of the logs
+		LOG_DEBUG("Dropping {} from the response cache.",
+			std::string_view(_entries.back().key).substr(0, _entries.back().key.find('\n')));
+		_size -= _entries.back().size;
+		_index.erase(_entries.back().key);
+		_entries.pop_back();
+	}
+}
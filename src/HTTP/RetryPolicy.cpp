@@ -0,0 +1,123 @@
+#include <HTTP/RetryPolicy.h>
+#include <Logger.h>
+
+#include <algorithm>
+#include <charconv>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+RetryPolicy::RetryPolicy() :
+	_max_retries(0), _base(BASE_DELAY), _max(MAX_DELAY), _max_retry_after(MAX_RETRY_AFTER),
+	_retry_non_idempotent(false), _random(std::random_device{}())
+{
+}
+
+void RetryPolicy::SetMaxRetries(int max_retries)
+{
+	_max_retries = std::max(max_retries, 0);
+}
+
+void RetryPolicy::SetBackoff(Clock::duration base, Clock::duration max)
+{
+	_base = base;
+	_max = std::max(base, max);
+}
+
+void RetryPolicy::SetMaxRetryAfter(Clock::duration max)
+{
+	_max_retry_after = max;
+}
+
+void RetryPolicy::SetRetryNonIdempotent(bool enable)
+{
+	_retry_non_idempotent = enable;
+}
+
+bool RetryPolicy::ShouldRetry(const std::string& method, int retries, ECode err, const HTTPResponse* response, Clock::duration& delay)
+{
+	if (retries >= _max_retries || (!_retry_non_idempotent && !IsIdempotent(method))) {
+		return false;
+	}
+
+	if (!response) {
+		if (err != ECode::SOCKET_CONNECT && err != ECode::SOCKET_SEND && err != ECode::SOCKET_RECV) {
+			return false;
+		}
+
+		delay = GetBackoff(retries);
+		return true;
+	}
+
+	// 501 / 505 won't get better by asking again
+	int code = response->GetCode();
+	if (code != 429 && (code < 500 || code > 599 || code == 501 || code == 505)) {
+		return false;
+	}
+
+	delay = GetBackoff(retries);
+
+	auto retry_after = response->GetHeader("retry-after");
+	Clock::duration wait;
+	if (retry_after && ParseRetryAfter(*retry_after, wait)) {
+		if (wait > _max_retry_after) {
+			LOG_DEBUG("Retry-After is too far away, not retrying.");
+			return false;
+		}
+
+		// still jittered, everyone got the same Retry-After
+		delay = wait + std::min(delay, _base);
+	}
+
+	return true;
+}
+
+bool RetryPolicy::IsIdempotent(const std::string& method)
+{
+	return method == "GET" || method == "HEAD" || method == "DELETE" || method == "PUT" || method == "OPTIONS";
+}
+
+bool RetryPolicy::ParseRetryAfter(std::string_view value, Clock::duration& delay)
+{
+	long long seconds = 0;
+
+	auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), seconds);
+	if (ec == std::errc() && end == value.data() + value.size()) {
+		delay = std::chrono::seconds(std::max(seconds, 0LL));
+		return true;
+	}
+
+	// IMF-fixdate, eg: "Sun, 06 Nov 1994 08:49:37 GMT"
+	std::tm tm{};
+	std::istringstream in{ std::string(value) };
+
+	in.imbue(std::locale::classic());
+	in >> std::get_time(&tm, "%a, %d %b %Y %H:%M:%S");
+	if (in.fail()) {
+		return false;
+	}
+
+#ifdef _WIN32
+	std::time_t when = _mkgmtime(&tm);
+#else
+	std::time_t when = timegm(&tm);
+#endif
+	if (when == -1) {
+		return false;
+	}
+
+	delay = std::chrono::seconds(std::max<long long>(when - std::time(nullptr), 0));
+	return true;
+}
+
+RetryPolicy::Clock::duration RetryPolicy::GetBackoff(int retries)
+{
+	// full jitter: uniform in [0, cap]
+	Clock::duration cap = _base * (1LL << std::min(retries, 30));
+	if (cap > _max || cap < _base) {
+		cap = _max;
+	}
+
+	std::uniform_int_distribution<Clock::rep> distribution(0, cap.count());
+	return Clock::duration(distribution(_random));
+}
@@ -0,0 +1,234 @@
+#include <HTTP/SocketTransport.h>
+#include <Logger.h>
+
+Transport::Kind SocketTransport::GetKind() const
+{
+	return Kind::SOCKETS;
+}
+
+SOCKET SocketTransport::Socket(int family)
+{
+	SOCKET sockfd = socket(family, SOCK_STREAM, IPPROTO_TCP);
+	if (sockfd == INVALID_SOCKET) {
+		LOG_ERROR("Socket creation failed, sockerr: {}", SYS_SOCKET_ERROR);
+		return INVALID_SOCKET;
+	}
+
+	if (!SysSetNonBlocking(sockfd)) {
+		LOG_ERROR("Couldn't make socket non-blocking, sockerr: {}", SYS_SOCKET_ERROR);
+		closesocket(sockfd);
+		return INVALID_SOCKET;
+	}
+
+	return sockfd;
+}
+
+bool SocketTransport::Add(SOCKET sockfd, Handler* handler)
+{
+	auto entry = std::make_unique<Entry>();
+
+	entry->owner = this;
+	entry->sockfd = sockfd;
+	entry->id = _next_id++;
+	entry->handler = handler;
+	entry->connecting = false;
+	entry->recv_buffer = nullptr;
+	entry->recv_len = 0;
+
+	if (!_loop.Add(sockfd, EventLoop::EVENT_NONE, entry.get())) {
+		return false;
+	}
+
+	_entries[sockfd] = std::move(entry);
+	return true;
+}
+
+void SocketTransport::Remove(SOCKET sockfd)
+{
+	_loop.Remove(sockfd);
+	_entries.erase(sockfd);
+}
+
+bool SocketTransport::Connect(SOCKET sockfd, const SysAddress& address)
+{
+	auto it = _entries.find(sockfd);
+	if (it == _entries.end()) {
+		return false;
+	}
+	Entry& entry = *it->second;
+
+	int ret = connect(sockfd, address.Get(), address.length);
+	if (ret == 0) {
+		_completions.push_back({ sockfd, entry.id, Op::CONNECT, 0 });
+		return true;
+	}
+
+	int err = SYS_SOCKET_ERROR;
+	if (SYS_CONNECT_PENDING(err)) {
+		entry.connecting = true;
+		UpdateEvents(entry);
+	}
+	else {
+		_completions.push_back({ sockfd, entry.id, Op::CONNECT, -err });
+	}
+	return true;
+}
+
+bool SocketTransport::Send(SOCKET sockfd, const SysIoVec* iov, size_t count)
+{
+	auto it = _entries.find(sockfd);
+	if (it == _entries.end()) {
+		return false;
+	}
+	Entry& entry = *it->second;
+
+	// the socket buffer usually has room, no need to wait for the event loop
+	int sent_bytes = SysSendV(sockfd, iov, count);
+	if (sent_bytes != SOCKET_ERROR) {
+		_completions.push_back({ sockfd, entry.id, Op::SEND, sent_bytes });
+		return true;
+	}
+
+	int err = SYS_SOCKET_ERROR;
+	if (SYS_WOULD_BLOCK(err)) {
+		entry.send_iov.assign(iov, iov + count);
+		UpdateEvents(entry);
+	}
+	else {
+		_completions.push_back({ sockfd, entry.id, Op::SEND, -err });
+	}
+	return true;
+}
+
+bool SocketTransport::Recv(SOCKET sockfd, char* buffer, size_t len)
+{
+	auto it = _entries.find(sockfd);
+	if (it == _entries.end()) {
+		return false;
+	}
+	Entry& entry = *it->second;
+
+	entry.recv_buffer = buffer;
+	entry.recv_len = len;
+	UpdateEvents(entry);
+	return true;
+}
+
+int SocketTransport::Poll(int timeout_ms)
+{
+	int handled = 0;
+
+	while (!_completions.empty()) {
+		Completion completion = _completions.front();
+		_completions.pop_front();
+
+		Deliver(completion);
+		++handled;
+	}
+
+	int ret = _loop.Poll(handled ? 0 : timeout_ms);
+	if (ret < 0) {
+		return -1;
+	}
+
+	return handled + ret;
+}
+
+size_t SocketTransport::GetCount() const
+{
+	return _entries.size();
+}
+
+void SocketTransport::UpdateEvents(Entry& entry)
+{
+	int events = EventLoop::EVENT_NONE;
+
+	if (entry.recv_buffer) {
+		events |= EventLoop::EVENT_READ;
+	}
+	if (entry.connecting || !entry.send_iov.empty()) {
+		events |= EventLoop::EVENT_WRITE;
+	}
+	_loop.Modify(entry.sockfd, events);
+}
+
+void SocketTransport::Deliver(const Completion& completion)
+{
+	auto it = _entries.find(completion.sockfd);
+	if (it == _entries.end() || it->second->id != completion.id) {
+		return;
+	}
+
+	Transport::Handler* handler = it->second->handler;
+	switch (completion.op) {
+	case Op::CONNECT: handler->OnConnect(completion.result); break;
+	case Op::SEND:    handler->OnSend(completion.result); break;
+	case Op::RECV:    handler->OnRecv(completion.result); break;
+	}
+}
+
+void SocketTransport::Entry::OnEvent(int events)
+{
+	// handlers may remove this socket, so `this` isn't touched after calling one
+	// unless the entry is still there
+	SocketTransport* transport = owner;
+	SOCKET fd = sockfd;
+	uint64_t entry_id = id;
+	auto alive = [transport, fd, entry_id]() {
+		auto it = transport->_entries.find(fd);
+		return it != transport->_entries.end() && it->second->id == entry_id;
+	};
+
+	if (connecting && (events & (EventLoop::EVENT_WRITE | EventLoop::EVENT_ERROR))) {
+		int err = 0;
+		socklen_t len = sizeof(err);
+
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &len) == SOCKET_ERROR) {
+			err = SYS_SOCKET_ERROR;
+		}
+
+		connecting = false;
+		handler->OnConnect(-err);
+		if (!alive()) {
+			return;
+		}
+		transport->UpdateEvents(*this);
+	}
+
+	if (!send_iov.empty() && (events & (EventLoop::EVENT_WRITE | EventLoop::EVENT_ERROR))) {
+		int sent_bytes = SysSendV(fd, send_iov.data(), send_iov.size());
+		int err = sent_bytes == SOCKET_ERROR ? SYS_SOCKET_ERROR : 0;
+
+		if (sent_bytes != SOCKET_ERROR || !SYS_WOULD_BLOCK(err)) {
+			send_iov.clear();
+			handler->OnSend(sent_bytes != SOCKET_ERROR ? sent_bytes : -err);
+			if (!alive()) {
+				return;
+			}
+			transport->UpdateEvents(*this);
+		}
+	}
+
+	// a full buffer means there's probably more waiting, keep reading while the handler asks for it
+	while (recv_buffer && (events & (EventLoop::EVENT_READ | EventLoop::EVENT_ERROR))) {
+		size_t len = recv_len;
+		int recv_bytes = recv(fd, recv_buffer, static_cast<int>(len), 0);
+		int err = recv_bytes == SOCKET_ERROR ? SYS_SOCKET_ERROR : 0;
+
+		if (recv_bytes == SOCKET_ERROR && SYS_WOULD_BLOCK(err)) {
+			break;
+		}
+
+		recv_buffer = nullptr;
+		handler->OnRecv(recv_bytes != SOCKET_ERROR ? recv_bytes : -err);
+		if (!alive()) {
+			return;
+		}
+		if (recv_bytes <= 0 || static_cast<size_t>(recv_bytes) < len) {
+			break;
+		}
+	}
+
+	// handlers usually queue the next operation right away, so this rarely changes anything
+	transport->UpdateEvents(*this);
+}
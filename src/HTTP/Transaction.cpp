@@ -0,0 +1,35 @@
+#include <HTTP/Transaction.h>
+
+size_t HTTPTransaction::GetSize() const
+{
+	return request_line.size() + (static_headers ? static_headers->size() : 0) + (cookie_header ? cookie_header->size() : 0) +
+		headers.size() + body.size();
+}
+
+size_t HTTPTransaction::GetIoVecs(SysIoVec* iov, size_t max) const
+{
+	std::string_view segments[] = {
+		request_line,
+		static_headers ? std::string_view(*static_headers) : std::string_view(),
+		cookie_header ? std::string_view(*cookie_header) : std::string_view(),
+		headers,
+		body
+	};
+	size_t skip = sent;
+	size_t count = 0;
+
+	for (const auto& segment : segments) {
+		if (skip >= segment.size()) {
+			skip -= segment.size();
+			continue;
+		}
+		if (count == max) {
+			break;
+		}
+
+		SysIoVecSet(iov[count++], segment.data() + skip, segment.size() - skip);
+		skip = 0;
+	}
+
+	return count;
+}
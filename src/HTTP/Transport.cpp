@@ -0,0 +1,21 @@
+#include <HTTP/Transport.h>
+#include <HTTP/SocketTransport.h>
+#include <HTTP/UringTransport.h>
+#include <Logger.h>
+
+std::unique_ptr<Transport> Transport::Create(Kind kind)
+{
+#ifdef __linux__
+	if (kind == Kind::IO_URING) {
+		auto transport = std::make_unique<UringTransport>();
+		if (transport->Init()) {
+			return transport;
+		}
+	}
+#endif
+
+	if (kind != Kind::SOCKETS) {
+		LOG_WARNING("io_uring isn't available, falling back to plain sockets.");
+	}
+	return std::make_unique<SocketTransport>();
+}
@@ -0,0 +1,444 @@
+#ifdef __linux__
+
+#include <HTTP/UringTransport.h>
+#include <Logger.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+UringTransport::UringTransport() :
+	_ring_fd(-1), _sq_ring(MAP_FAILED), _cq_ring(MAP_FAILED), _sq_ring_size(0), _cq_ring_size(0),
+	_sqes(static_cast<io_uring_sqe*>(MAP_FAILED)), _sqes_size(0),
+	_sq_head(nullptr), _sq_tail(nullptr), _sq_mask(nullptr), _sq_array(nullptr), _sq_entries(0), _sqe_tail(0), _to_submit(0),
+	_cq_head(nullptr), _cq_tail(nullptr), _cq_mask(nullptr), _cqes(nullptr),
+	_next_id(1), _timeout{}, _ext_arg(false), _timeout_op(0)
+{
+}
+
+UringTransport::~UringTransport()
+{
+	if (_sqes != MAP_FAILED) {
+		munmap(_sqes, _sqes_size);
+	}
+	if (_cq_ring != MAP_FAILED && _cq_ring != _sq_ring) {
+		munmap(_cq_ring, _cq_ring_size);
+	}
+	if (_sq_ring != MAP_FAILED) {
+		munmap(_sq_ring, _sq_ring_size);
+	}
+	if (_ring_fd != -1) {
+		close(_ring_fd);
+	}
+}
+
+bool UringTransport::Init(unsigned entries)
+{
+	io_uring_params params{};
+
+	_ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+	if (_ring_fd < 0) {
+		LOG_DEBUG("io_uring_setup failed, errno: {}", errno);
+		_ring_fd = -1;
+		return false;
+	}
+
+	_ext_arg = (params.features & IORING_FEAT_EXT_ARG) != 0;
+
+	_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		_sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+	}
+
+	_sq_ring = mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+	if (_sq_ring == MAP_FAILED) {
+		LOG_DEBUG("io_uring SQ ring mmap failed, errno: {}", errno);
+		return false;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		_cq_ring = _sq_ring;
+	}
+	else {
+		_cq_ring = mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+		if (_cq_ring == MAP_FAILED) {
+			LOG_DEBUG("io_uring CQ ring mmap failed, errno: {}", errno);
+			return false;
+		}
+	}
+
+	_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	_sqes = static_cast<io_uring_sqe*>(mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES));
+	if (_sqes == MAP_FAILED) {
+		LOG_DEBUG("io_uring SQE mmap failed, errno: {}", errno);
+		return false;
+	}
+
+	char* sq = static_cast<char*>(_sq_ring);
+	_sq_head  = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+	_sq_tail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	_sq_mask  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+	_sq_entries = params.sq_entries;
+	_sqe_tail = *_sq_tail;
+
+	char* cq = static_cast<char*>(_cq_ring);
+	_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	_cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	_cqes    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+	// the socket operations need a 5.6+ kernel
+	std::vector<char> probe_storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+	io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probe_storage.data());
+
+	if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+		LOG_DEBUG("io_uring probe failed, errno: {}", errno);
+		return false;
+	}
+
+	for (int op : { IORING_OP_CONNECT, IORING_OP_SENDMSG, IORING_OP_RECV, IORING_OP_ASYNC_CANCEL, IORING_OP_TIMEOUT, IORING_OP_TIMEOUT_REMOVE }) {
+		if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+			LOG_DEBUG("io_uring opcode {} isn't supported.", op);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+Transport::Kind UringTransport::GetKind() const
+{
+	return Kind::IO_URING;
+}
+
+SOCKET UringTransport::Socket(int family)
+{
+	// blocking on purpose: io_uring waits for readiness itself instead of failing with EAGAIN
+	SOCKET sockfd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+	if (sockfd == INVALID_SOCKET) {
+		LOG_ERROR("Socket creation failed, sockerr: {}", SYS_SOCKET_ERROR);
+	}
+	return sockfd;
+}
+
+bool UringTransport::Add(SOCKET sockfd, Handler* handler)
+{
+	_entries[sockfd] = { _next_id++, handler, { 0, 0, 0 } };
+	return true;
+}
+
+void UringTransport::Remove(SOCKET sockfd)
+{
+	auto it = _entries.find(sockfd);
+	if (it == _entries.end()) {
+		return;
+	}
+
+	Entry entry = it->second;
+	_entries.erase(it);
+
+	// the kernel may still be using the buffers, cancel everything and wait for it to let go;
+	// completions of other sockets that show up meanwhile are kept for the next Poll()
+	size_t in_flight = 0;
+	for (uint64_t op : entry.ops) {
+		auto it = _ops.find(op);
+		if (it == _ops.end()) {
+			continue;
+		}
+
+		// already completed, just make sure it's never dispatched
+		if (it->second.reaped) {
+			_ops.erase(it);
+			continue;
+		}
+
+		uint64_t user_data;
+		io_uring_sqe* sqe = Queue(-1, 0, OP_CANCEL, user_data);
+		if (sqe) {
+			sqe->addr = op;
+		}
+		++in_flight;
+	}
+	if (in_flight) {
+		shutdown(sockfd, SHUT_RDWR);
+	}
+
+	std::vector<Completion> completions;
+	while (in_flight) {
+		if (Enter(1) < 0 && errno != EINTR) {
+			LOG_ERROR("io_uring_enter failed while cancelling, errno: {}", errno);
+			break;
+		}
+
+		completions.clear();
+		Reap(completions);
+
+		for (const auto& completion : completions) {
+			auto op = _ops.find(completion.user_data);
+			if (op != _ops.end() && op->second.sockfd == sockfd && op->second.entry_id == entry.id) {
+				_ops.erase(op);
+				--in_flight;
+			}
+			else {
+				_deferred.push_back(completion);
+			}
+		}
+	}
+}
+
+bool UringTransport::Connect(SOCKET sockfd, const SysAddress& address)
+{
+	auto it = _entries.find(sockfd);
+	if (it == _entries.end()) {
+		return false;
+	}
+
+	io_uring_sqe* sqe = Queue(sockfd, it->second.id, OP_CONNECT, it->second.ops[OP_CONNECT]);
+	if (!sqe) {
+		return false;
+	}
+
+	Operation& op = _ops[it->second.ops[OP_CONNECT]];
+	op.address = address;
+	sqe->addr = reinterpret_cast<uint64_t>(&op.address.storage);
+	sqe->off = op.address.length;
+	return true;
+}
+
+bool UringTransport::Send(SOCKET sockfd, const SysIoVec* iov, size_t count)
+{
+	auto it = _entries.find(sockfd);
+	if (it == _entries.end()) {
+		return false;
+	}
+
+	io_uring_sqe* sqe = Queue(sockfd, it->second.id, OP_SEND, it->second.ops[OP_SEND]);
+	if (!sqe) {
+		return false;
+	}
+
+	// the kernel reads the message header when it gets to the operation, keep it with it
+	Operation& op = _ops[it->second.ops[OP_SEND]];
+	op.iov.assign(iov, iov + count);
+	op.msg = {};
+	op.msg.msg_iov = op.iov.data();
+	op.msg.msg_iovlen = op.iov.size();
+
+	sqe->addr = reinterpret_cast<uint64_t>(&op.msg);
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	return true;
+}
+
+bool UringTransport::Recv(SOCKET sockfd, char* buffer, size_t len)
+{
+	auto it = _entries.find(sockfd);
+	if (it == _entries.end()) {
+		return false;
+	}
+
+	io_uring_sqe* sqe = Queue(sockfd, it->second.id, OP_RECV, it->second.ops[OP_RECV]);
+	if (!sqe) {
+		return false;
+	}
+
+	Operation& op = _ops[it->second.ops[OP_RECV]];
+	op.buffer = buffer;
+	op.len = len;
+
+	sqe->addr = reinterpret_cast<uint64_t>(buffer);
+	sqe->len = static_cast<uint32_t>(len);
+	return true;
+}
+
+int UringTransport::Poll(int timeout_ms)
+{
+	std::vector<Completion> completions;
+	int handled = 0;
+
+	completions.swap(_deferred);
+
+	// submit everything queued since the last call and wait, all in one syscall
+	unsigned min_complete = (completions.empty() && timeout_ms != 0) ? 1 : 0;
+	const __kernel_timespec* timeout = nullptr;
+
+	// the timeout armed by the last wait (ended by something else) would cut this one short;
+	// it and its removal both complete, so they don't count as the completion waited for
+	auto armed = _ops.find(_timeout_op);
+	if (armed != _ops.end() && !armed->second.reaped) {
+		uint64_t user_data;
+		io_uring_sqe* sqe = Queue(-1, 0, OP_TIMEOUT_REMOVE, user_data);
+		if (sqe) {
+			sqe->addr = _timeout_op;
+			if (min_complete) {
+				min_complete += 2;
+			}
+		}
+	}
+	_timeout_op = 0;
+
+	if (min_complete && timeout_ms > 0) {
+		_timeout.tv_sec = timeout_ms / 1000;
+		_timeout.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+
+		if (_ext_arg) {
+			timeout = &_timeout;
+		}
+		else {
+			io_uring_sqe* sqe = Queue(-1, 0, OP_TIMEOUT, _timeout_op);
+			if (sqe) {
+				sqe->addr = reinterpret_cast<uint64_t>(&_timeout);
+				sqe->len = 1;
+				sqe->off = 1;
+			}
+		}
+	}
+
+	// ETIME: the wait timed out (with _ext_arg)
+	if ((_to_submit || min_complete) && Enter(min_complete, timeout) < 0) {
+		if (errno != EINTR && errno != ETIME) {
+			LOG_ERROR("io_uring_enter failed, errno: {}", errno);
+			return -1;
+		}
+	}
+
+	Reap(completions);
+	for (const auto& completion : completions) {
+		handled += Dispatch(completion);
+	}
+
+	return handled;
+}
+
+size_t UringTransport::GetCount() const
+{
+	return _entries.size();
+}
+
+io_uring_sqe* UringTransport::Queue(SOCKET sockfd, uint64_t entry_id, Op op, uint64_t& user_data)
+{
+	unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+
+	// ring full, hand what we have to the kernel first
+	if (_sqe_tail - head >= _sq_entries) {
+		Enter(0);
+		head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+		if (_sqe_tail - head >= _sq_entries) {
+			LOG_ERROR("io_uring submission queue is full.");
+			return nullptr;
+		}
+	}
+
+	unsigned index = _sqe_tail & *_sq_mask;
+	io_uring_sqe* sqe = &_sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	switch (op) {
+	case OP_CONNECT: sqe->opcode = IORING_OP_CONNECT; break;
+	case OP_SEND:    sqe->opcode = IORING_OP_SENDMSG; break;
+	case OP_RECV:    sqe->opcode = IORING_OP_RECV; break;
+	case OP_CANCEL:  sqe->opcode = IORING_OP_ASYNC_CANCEL; break;
+	case OP_TIMEOUT: sqe->opcode = IORING_OP_TIMEOUT; break;
+	case OP_TIMEOUT_REMOVE: sqe->opcode = IORING_OP_TIMEOUT_REMOVE; break;
+	}
+	sqe->fd = sockfd;
+
+	user_data = _next_id++;
+	sqe->user_data = user_data;
+	_ops[user_data] = { sockfd, entry_id, op, false, {}, {}, {}, nullptr, 0 };
+
+	_sq_array[index] = index;
+	++_sqe_tail;
+	++_to_submit;
+	return sqe;
+}
+
+int UringTransport::Enter(unsigned min_complete, const __kernel_timespec* timeout)
+{
+	unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+	io_uring_getevents_arg arg{};
+	int ret;
+
+	// publish the new submissions before the kernel looks at them
+	__atomic_store_n(_sq_tail, _sqe_tail, __ATOMIC_RELEASE);
+
+	if (timeout) {
+		arg.ts = reinterpret_cast<uint64_t>(timeout);
+		ret = static_cast<int>(syscall(__NR_io_uring_enter, _ring_fd, _to_submit, min_complete,
+			flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)));
+	}
+	else {
+		ret = static_cast<int>(syscall(__NR_io_uring_enter, _ring_fd, _to_submit, min_complete, flags, nullptr, 0));
+	}
+	if (ret > 0) {
+		_to_submit -= std::min<unsigned>(static_cast<unsigned>(ret), _to_submit);
+	}
+	return ret;
+}
+
+void UringTransport::Reap(std::vector<Completion>& completions)
+{
+	unsigned head = *_cq_head;
+	unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; ++head) {
+		const io_uring_cqe& cqe = _cqes[head & *_cq_mask];
+		completions.push_back({ cqe.user_data, cqe.res });
+
+		auto op = _ops.find(cqe.user_data);
+		if (op != _ops.end()) {
+			op->second.reaped = true;
+		}
+	}
+
+	__atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+}
+
+bool UringTransport::Dispatch(const Completion& completion)
+{
+	auto it = _ops.find(completion.user_data);
+	if (it == _ops.end()) {
+		return false;
+	}
+
+	Operation operation = std::move(it->second);
+	SOCKET sockfd = operation.sockfd;
+	Op op = operation.op;
+	_ops.erase(it);
+
+	auto entry = _entries.find(sockfd);
+	if (op == OP_CANCEL || op == OP_TIMEOUT || op == OP_TIMEOUT_REMOVE || entry == _entries.end() || entry->second.id != operation.entry_id) {
+		return false;
+	}
+
+	entry->second.ops[op] = 0;
+
+	// the kernel cancels what a thread submitted when that thread exits (the client may be driven
+	// by several); Remove() drops the operations it cancels itself, so this one is submitted again
+	if (completion.result == -ECANCELED) {
+		LOG_DEBUG("io_uring operation cancelled by the kernel, submitting it again.");
+		switch (op) {
+		case OP_CONNECT: Connect(sockfd, operation.address); break;
+		case OP_SEND:    Send(sockfd, operation.iov.data(), operation.iov.size()); break;
+		case OP_RECV:    Recv(sockfd, operation.buffer, operation.len); break;
+		default: break;
+		}
+		return false;
+	}
+
+	Handler* handler = entry->second.handler;
+	switch (op) {
+	case OP_CONNECT: handler->OnConnect(completion.result); break;
+	case OP_SEND:    handler->OnSend(completion.result); break;
+	case OP_RECV:    handler->OnRecv(completion.result); break;
+	default: break;
+	}
+	return true;
+}
+
+#endif
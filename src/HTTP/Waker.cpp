@@ -0,0 +1,84 @@
+#include <HTTP/Waker.h>
+#include <Logger.h>
+
+Waker::Waker() :
+	_transport(nullptr), _sockets{ INVALID_SOCKET, INVALID_SOCKET }, _buffer{}, _signaled(false)
+{
+	if (!SysSocketPair(_sockets)) {
+		LOG_ERROR("Couldn't create the wakeup sockets, sockerr: {}", SYS_SOCKET_ERROR);
+		return;
+	}
+
+	// Wake() never blocks; the read end stays blocking like the transports' own sockets
+	// (io_uring waits for the data itself), there's never enough to fill the buffer
+	if (!SysSetNonBlocking(_sockets[1])) {
+		LOG_ERROR("Couldn't make the wakeup socket non-blocking, sockerr: {}", SYS_SOCKET_ERROR);
+	}
+}
+
+Waker::~Waker()
+{
+	Detach();
+
+	for (SOCKET sockfd : _sockets) {
+		if (sockfd != INVALID_SOCKET) {
+			closesocket(sockfd);
+		}
+	}
+}
+
+bool Waker::Attach(Transport& transport)
+{
+	Detach();
+
+	if (_sockets[0] == INVALID_SOCKET || !transport.Add(_sockets[0], this)) {
+		return false;
+	}
+
+	_transport = &transport;
+	if (!_transport->Recv(_sockets[0], _buffer, sizeof(_buffer))) {
+		Detach();
+		return false;
+	}
+
+	return true;
+}
+
+void Waker::Detach()
+{
+	// a byte still unread is picked up by the next transport, that's one spurious wakeup
+	if (_transport) {
+		_transport->Remove(_sockets[0]);
+		_transport = nullptr;
+	}
+}
+
+void Waker::Wake()
+{
+	if (_sockets[1] == INVALID_SOCKET || _signaled.exchange(true)) {
+		return;
+	}
+
+	send(_sockets[1], "w", 1, SYS_SEND_FLAGS);
+}
+
+void Waker::OnConnect(int)
+{
+}
+
+void Waker::OnSend(int)
+{
+}
+
+void Waker::OnRecv(int result)
+{
+	// cleared before reading again: a Wake() from now on sends another byte
+	_signaled.store(false);
+
+	if (result <= 0) {
+		LOG_ERROR("Wakeup socket failed, errcode: {}", -result);
+		return;
+	}
+
+	_transport->Recv(_sockets[0], _buffer, sizeof(_buffer));
+}
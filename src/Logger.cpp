@@ -1,5 +1,7 @@
 #include <Logger.h>
 
+thread_local std::string* Logger::_capture = nullptr;
+
 Logger::Logger() :	_outputToFile(false), _outputToFileRules(0), _outputToStdout(false), _outputToStdoutRules(0),
 					_outputToDebugger(false), _outputToDebuggerRules(0)
 {
@@ -67,3 +69,14 @@ bool Logger::SetOutputToDebugger(bool enable, int rules)
 	_outputToDebuggerRules = rules;
 	return enable;
 }
+
+void Logger::SetCapture(std::string* buffer)
+{
+	_capture = buffer;
+}
+
+void Logger::SetStdoutSink(std::function<void(const std::string&)> sink)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_stdoutSink = std::move(sink);
+}
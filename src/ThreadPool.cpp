@@ -0,0 +1,127 @@
+#include <ThreadPool.h>
+
+namespace
+{
+	// the pool and worker running the calling thread, if any
+	thread_local const ThreadPool* current_pool = nullptr;
+	thread_local size_t current_worker = 0;
+}
+
+ThreadPool::ThreadPool(size_t workers) :
+	_next(0), _queued(0), _pending(0), _stop(false)
+{
+	if (workers == 0) {
+		workers = 1;
+	}
+
+	for (size_t i = 0; i < workers; ++i) {
+		_workers.push_back(std::make_unique<Worker>());
+	}
+	// started once all the queues exist, any of them may be stolen from
+	for (size_t i = 0; i < workers; ++i) {
+		_workers[i]->thread = std::thread(&ThreadPool::Work, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_work_cond.notify_all();
+
+	for (auto& worker : _workers) {
+		worker->thread.join();
+	}
+}
+
+void ThreadPool::Submit(Job job)
+{
+	size_t index = current_pool == this ? current_worker : _next++ % _workers.size();
+
+	++_pending;
+	{
+		std::lock_guard<std::mutex> lock(_workers[index]->mutex);
+		_workers[index]->jobs.push_back(std::move(job));
+	}
+
+	// counted under the mutex: a worker about to sleep either sees it or gets notified;
+	// another worker may have taken it already, the count just goes back to what it was
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_queued;
+	}
+	_work_cond.notify_one();
+}
+
+void ThreadPool::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_idle_cond.wait(lock, [this] { return _pending.load() == 0; });
+}
+
+size_t ThreadPool::GetPending() const
+{
+	return _pending.load();
+}
+
+void ThreadPool::Work(size_t index)
+{
+	current_pool = this;
+	current_worker = index;
+
+	while (true) {
+		Job job;
+
+		if (Take(index, job)) {
+			job();
+			job = nullptr;
+
+			if (--_pending == 0) {
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+				}
+				_idle_cond.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_work_cond.wait(lock, [this] { return _stop || _queued.load() > 0; });
+		if (_stop && _queued.load() <= 0) {
+			return;
+		}
+	}
+}
+
+bool ThreadPool::Take(size_t index, Job& job)
+{
+	// own queue first, newest job (its data is likely still in cache)
+	{
+		Worker& own = *_workers[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+
+		if (!own.jobs.empty()) {
+			job = std::move(own.jobs.back());
+			own.jobs.pop_back();
+			--_queued;
+			return true;
+		}
+	}
+
+	// then the others', oldest job first
+	for (size_t i = 1; i < _workers.size(); ++i) {
+		Worker& victim = *_workers[(index + i) % _workers.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+
+		if (!victim.jobs.empty()) {
+			job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			--_queued;
+			return true;
+		}
+	}
+
+	return false;
+}
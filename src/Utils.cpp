@@ -1,5 +1,6 @@
 #include <Utils.h>
 #include <algorithm>
+#include <cctype>
 
 namespace Utils
 {
@@ -38,4 +39,11 @@ namespace Utils
         std::transform(str.begin(), str.end(), std::back_inserter(ret), ::tolower);
         return ret;
     }
+
+    bool EqualsNoCase(std::string_view a, std::string_view b)
+    {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    }
 }